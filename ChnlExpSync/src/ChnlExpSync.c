@@ -60,22 +60,26 @@
 
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <NIDAQmx.h>
 #include <math.h>
-#include <fftw3.h>
+#include "SyncCommon.h"
 
 static TaskHandle taskHandle=0;
+static uInt32 numChannels=0; // Number of channels in the task, read back from DAQmx at startup
 
 #define DAQmxErrChk(functionCall) if( DAQmxFailed(error=(functionCall)) ) goto Error; else
-#define REAL 0
-#define IMAG 1
-#define PI 3.14159265
 
 int32 EveryNCallback(TaskHandle taskHandle, int32 everyNsamplesEventType, uInt32 nSamples, void *callbackData);
 int32 DoneCallback(TaskHandle taskHandle, int32 status, void *callbackData);
-void DFT(double *dsaData, double *mioData, double sampleRate, long long int sampsPerChan, int precision, FILE *file, double *measuredPhaseSkewDeg, double *measuredPhaseSkewSec, double *measuredFreq);
-void StoreData(int arraySize, double *dataToAllocate, double *output);
-double NormalizePhaseAngleDifference(double phase);
+int DFT(DFTReal *data, double *sourceData, DFTComplex *workerSpectra, int numChannels, double sampleRate, long long int sampsPerChan, int precision, FILE *file, double *measuredPhaseSkewDeg, double *measuredPhaseSkewSec, double *measuredFreq);
+void CarveAcquisitionArena(int length, int channels);
+void AnalyzeBlock(void *callbackData, float64 *totalData, int32 *codes, DFTComplex *spectra, int32 samplesReadPerChan, int32 skipped);
+void AnalyzeRingSlot(void *callbackData, AnalysisRingSlot *slot);
+void TransformBlock(AnalysisRingSlot *slot);
+AnalysisRingSlot *BlockDestination(float64 **totalData, int32 **codes);
+void DeliverBlock(void *callbackData, AnalysisRingSlot *slot, float64 *totalData, int32 *codes, int32 samplesReadPerChan);
+void ScaleRawBlock(int32 *codes, float64 *data);
 
 /*********************************************/
 // DAQmx Configuration Options
@@ -107,14 +111,15 @@ const uInt32 options = 0; // Use this parameter to set certain options. Pass a v
 
 // DAQmxReadAnalogF64 Options
 const float64 timeout = 10.0; // The amount of time, in seconds, to wait for the function to read the sample(s).
-const bool32 fillMode = DAQmx_Val_GroupByScanNumber; // Specifies whether or not the samples are interleaved. Options: DAQmx_Val_GroupByChannel, DAQmx_Val_GroupByScanNumber
+const bool32 fillMode = DAQmx_Val_GroupByChannel; // Specifies whether or not the samples are interleaved. The DFT reads each channel as one contiguous block, so this must be DAQmx_Val_GroupByChannel.
 
-// Create file variables and their names
+/*********************************************/
+// Program Options
+/*********************************************/
+// The analysis options shared by all three programs are set in SyncCommon/src/SyncOptions.c
+
+// CSV files
 FILE *dataFile, *dftFile;
-const char *voltageDataFileName = "../../VoltageData.csv"; // Measurement data is stored in this CSV file
-const char *dftDataFileName = "../../DFTData.csv"; // DFT data is stored in this CSV file
-const int voltageDataFileLogPrecision = 2; // Precision at which to store the voltage data
-const int dftDataFileLogPrecision = 3; // Precision at which to store the dft data
 typedef struct {
 	FILE *file;
 	int precision;
@@ -122,15 +127,37 @@ typedef struct {
 typedef struct {
 	LogFile voltageData;
 	LogFile dftData;
+	LogFile slidingSkewData; // Only opened when slidingDFT is enabled
+	LogFile gccPhatData; // Only opened when gccPhatEstimator is enabled
+	LogFile harmonicData; // Only opened when harmonicAnalysis is enabled
+	LogFile multiToneData; // Only opened when multiToneDetection is enabled
 } Logs;
 typedef Logs *LogsPtr;
+char channelNames[MAX_CHANNELS][256]; // Virtual channel names, used to label the CSV columns
+static RawScaling rawScaling[MAX_CHANNELS]; // Raw reads only: scaling of every channel
+
+// Acquisition arena buffers
+// The sample and spectrum buffers of this program, carved out of the acquisition arena by CarveAcquisitionArena()
+typedef struct {
+	float64 *totalData; // Samples of every channel as read from DAQmx; channel c starts at totalData[c*sampsPerChan]
+	int32 *codes; // Raw reads only: codes of every channel read from DAQmx without a ring slot, laid out like totalData
+	DFTReal *dftData; // Converted or windowed copy of totalData, only carved if the DFT cannot read totalData directly
+	DFTComplex *output; // Spectra of every channel; channel c starts at output[c*(sampsPerChan/2+1)]
+	DFTReal *magnitudes, *amplitudes; // Magnitudes and amplitudes of every bin, laid out like output
+	float64 *batchData; // Catch-up reads only: samples of up to maxCatchUpBlocks blocks, laid out as DAQmx reads them
+	int32 *batchCodes; // Catch-up and raw reads only: codes of up to maxCatchUpBlocks blocks, laid out like batchData
+} AcquisitionArena;
+static AcquisitionArena arena;
+
+// Harmonic analysis results of the latest block, one per channel
+static HarmonicResult harmonicResults[MAX_CHANNELS];
 
 int main(void)
 {
 	int32       error=0;
 	char        errBuff[2048]={'\0'};
 	char	    channels[256],trigName[256];
-	LogFile 	voltageDataFile, dftDataFile;
+	LogFile 	voltageDataFile, dftDataFile, slidingSkewDataFile, gccPhatDataFile, harmonicDataFile, multiToneDataFile;
 	Logs		logData;
 
  	/*********************************************/
@@ -141,21 +168,109 @@ int main(void)
 	DAQmxErrChk (DAQmxCfgSampClkTiming(taskHandle,"",sampleRate,activeEdge,sampleMode,sampsPerChan));
 	DAQmxErrChk (DAQmxSetAIRemoveFilterDelay(taskHandle,dsaDeviceName,1)); 
 
+	// Every channel in physicalChannels is transformed and compared against the first (DSA) channel
+	DAQmxErrChk (DAQmxGetTaskNumChans(taskHandle,&numChannels));
+	if (numChannels < 2 || numChannels > MAX_CHANNELS)
+	{
+		printf("Between 2 and %d channels are required, %u were configured\n",MAX_CHANNELS,(unsigned)numChannels);
+		goto Error;
+	}
+	for (uInt32 i = 0; i < numChannels; i++)
+		DAQmxErrChk (DAQmxGetNthTaskChannel(taskHandle,i+1,channelNames[i],sizeof(channelNames[i])));
+
+	// Fetch the polynomials that scale the raw codes to volts
+	if (rawReads)
+	{
+		for (uInt32 i = 0; i < numChannels; i++)
+			DAQmxErrChk (InitRawScaling(taskHandle,channelNames[i],&rawScaling[i]));
+	}
+
 	DAQmxErrChk (DAQmxSetRefClkSrc(taskHandle, refClkSrc));
 
+	// Size the input buffer for the stall budget
+	DAQmxErrChk (ConfigureInputBuffers(&taskHandle,1,numChannels));
+
 	// Create two CSV files and set precision
 	voltageDataFile.file = fopen(voltageDataFileName, "w");
 	dftDataFile.file = fopen(dftDataFileName, "w");
 	voltageDataFile.precision = voltageDataFileLogPrecision;
 	dftDataFile.precision = dftDataFileLogPrecision;
 
+	// Create the sliding phase skew CSV file if it is used
+	slidingSkewDataFile.file = slidingDFT ? fopen(slidingSkewDataFileName, "w") : NULL;
+	slidingSkewDataFile.precision = dftDataFileLogPrecision;
+	if (slidingSkewDataFile.file != NULL)
+	{
+		fprintf(slidingSkewDataFile.file,"Time (s),Frequency (Hz)");
+		for (uInt32 c = 1; c < numChannels; c++)
+			fprintf(slidingSkewDataFile.file,",%s Skew (deg),%s Skew (sec)",channelNames[c],channelNames[c]);
+		fprintf(slidingSkewDataFile.file,"\n");
+	}
+
+	// Create the GCC-PHAT delay CSV file if it is used
+	gccPhatDataFile.file = gccPhatEstimator ? fopen(gccPhatDataFileName, "w") : NULL;
+	gccPhatDataFile.precision = dftDataFileLogPrecision;
+	if (gccPhatDataFile.file != NULL)
+	{
+		fprintf(gccPhatDataFile.file,"Samples Acquired");
+		for (uInt32 c = 1; c < numChannels; c++)
+			fprintf(gccPhatDataFile.file,",%s Integer Delay (samples),%s Fractional Delay (samples),%s Delay (sec)",channelNames[c],channelNames[c],channelNames[c]);
+		fprintf(gccPhatDataFile.file,"\n");
+	}
+
+	// Create the harmonic analysis CSV file if it is used
+	harmonicDataFile.file = harmonicAnalysis ? fopen(harmonicDataFileName, "w") : NULL;
+	harmonicDataFile.precision = dftDataFileLogPrecision;
+	if (harmonicDataFile.file != NULL)
+	{
+		fprintf(harmonicDataFile.file,"Samples Acquired");
+		for (uInt32 c = 0; c < numChannels; c++)
+			fprintf(harmonicDataFile.file,",%s Fundamental (Hz),%s THD (dB),%s SINAD (dB),%s SFDR (dBc),%s ENOB (bits),%s Skew (sec)",channelNames[c],channelNames[c],channelNames[c],channelNames[c],channelNames[c],channelNames[c]);
+		fprintf(harmonicDataFile.file,"\n");
+	}
+
+	// Create the multi-tone CSV file if it is used
+	multiToneDataFile.file = multiToneDetection ? fopen(multiToneDataFileName, "w") : NULL;
+	multiToneDataFile.precision = dftDataFileLogPrecision;
+	if (multiToneDataFile.file != NULL)
+	{
+		fprintf(multiToneDataFile.file,"Samples Acquired,Tone,Frequency (Hz)");
+		for (uInt32 c = 0; c < numChannels; c++)
+			fprintf(multiToneDataFile.file,",%s Amplitude (V)",channelNames[c]);
+		for (uInt32 c = 1; c < numChannels; c++)
+			fprintf(multiToneDataFile.file,",%s Skew (deg),%s Skew (sec)",channelNames[c],channelNames[c]);
+		fprintf(multiToneDataFile.file,"\n");
+	}
+
 	// Store information in a single struct
 	logData.voltageData = voltageDataFile;
 	logData.dftData = dftDataFile;
+	logData.slidingSkewData = slidingSkewDataFile;
+	logData.gccPhatData = gccPhatDataFile;
+	logData.harmonicData = harmonicDataFile;
+	logData.multiToneData = multiToneDataFile;
 	
 	DAQmxErrChk (DAQmxRegisterEveryNSamplesEvent(taskHandle,everyNsamplesEventType,sampsPerChan,options,EveryNCallback,&logData));
 	DAQmxErrChk (DAQmxRegisterDoneEvent(taskHandle,0,DoneCallback,&logData));
 
+	// Create the DFT window and plans before the first callback can run
+	InitDFTWindow(sampsPerChan);
+	InitDFTThreads();
+	if (dftThreadBenchmark)
+		RunDFTThreadBenchmark(sampsPerChan,numChannels);
+	if (spectrumKernelBenchmark)
+		RunSpectrumKernelBenchmark(numChannels < 4 ? numChannels : 4); // Capped so the 1M bin spectra fit in memory
+	InitAcquisitionArena(CarveAcquisitionArena,sampsPerChan,numChannels);
+	if (zoomFFT)
+		InitZoomFFT();
+	if (spectrogram)
+		InitSpectrogram(sampsPerChan,numChannels,sampleRate);
+	// Without every startup plan in the cache the blocks could not be analysed, so the program stops before acquiring
+	if (InitDFTPlanCache(sampsPerChan,numChannels,(DFTReal*)arena.totalData,arena.output) != 0)
+		goto Error;
+	if (analysisThread)
+		InitAnalysisRing(&logData,AnalyzeRingSlot,TransformBlock);
+
 	/*********************************************/
 	// DAQmx Start Code
 	/*********************************************/
@@ -166,8 +281,16 @@ int main(void)
 	printf("Acquiring samples continuously. Press Enter to interrupt.\n");
 	printf("*********************************************************\n\n");
 	printf("Sample rate (Hz): %6.2f\n", sampleRate);
-	printf("Samples per channel: %llu\n\n", sampsPerChan);
-	printf("DSA Samples Acquired\tMIO Samples Acquired\tDetected Signal Frequency (Hz)\t\tPhase Skew (deg)\tPhase Skew (sec)\n");
+	printf("Samples per channel: %llu\n", sampsPerChan);
+	printf("DFT precision: %s\n", DFT_SINGLE_PRECISION ? "float32" : "float64");
+	if (welchAveraging)
+		printf("Phase skew averaging: %s\n", welchAveraging == 1 ? "exponential" : "fixed window");
+	ReportDFTBackends();
+	printf("DFT planning (s): %1.3f (%d plan(s) from wisdom, %d measured)\n\n", dftPlanCache.planningTimeSec, dftPlanCache.plansFromWisdom, dftPlanCache.plansMeasured);
+	printf("DSA Samples Acquired\tMIO Samples Acquired\tDetected Signal Frequency (Hz)\t\tPhase Skew (deg)\tPhase Skew (sec)");
+	for (uInt32 i = 2; i < numChannels; i++)
+		printf("\t%s Skew (deg)\t%s Skew (sec)",channelNames[i],channelNames[i]);
+	printf("\n");
 	getchar();
 
 Error:
@@ -183,6 +306,37 @@ Error:
 		taskHandle = 0;
 	}
 
+	// Let the analysis thread finish the blocks still in the ring
+	DestroyAnalysisRing();
+
+	// Report how many DFT plans were created and free them
+	printf("\nDFT plans created at startup: %d, during acquisition: %d\n",dftPlanCache.plansCreatedAtStartup,dftPlanCache.plansCreatedDuringAcquisition);
+	if (dftPlanCache.plansRefused > 0)
+		printf("WARNING: %d DFT plan lookup(s) found the cache full and their work was skipped\n",dftPlanCache.plansRefused);
+	DestroyDFTPlanCache();
+	DestroyDFTThreads();
+	FFTW(free)(dftWindow);
+
+	// Planning allocates memory, so a plan created during acquisition means a callback allocated
+	printf("Acquisition arena (bytes): %zu\n",arenaAllocator.size);
+	if (dftPlanCache.plansCreatedDuringAcquisition > 0)
+		printf("WARNING: memory was allocated while acquiring\n");
+	if (analysisThread)
+		printf("Analysis ring (blocks): mean occupancy %1.2f, high-water mark %u of %d, %u dropped\n",analysisRing.head > 0 ? (double)analysisRing.occupancySum / analysisRing.head : 0.0,analysisRing.highWater,analysisRingSlots,analysisRing.dropped);
+	if (AnalysisWorkerCount() > 0)
+		printf("Analysis workers: %d, blocks finished out of order: %u\n",AnalysisWorkerCount(),analysisRing.reordered);
+	if (inputBuffer.size > 0 && (catchUpReads || bufferFillWarning > 0))
+		printf("Input buffer fill (samples per channel): peak %u of %u (%1.0f%%), %u warning(s)\n",(unsigned)inputBuffer.peakFill,(unsigned)inputBuffer.size,100.0 * inputBuffer.peakFill / inputBuffer.size,inputBuffer.warnings);
+	if (catchUpReads)
+		printf("Catch-up reads (blocks): mean backlog %1.2f, largest backlog %d, %u batched read(s) of %u block(s), %u read(s) left a backlog behind\n",catchUp.callbacks > 0 ? (double)catchUp.backlogSum / catchUp.callbacks : 0.0,catchUp.maxBacklog,catchUp.batches,catchUp.batchedBlocks,catchUp.leftBehind);
+	// The spectrogram file's stdio buffer is carved from the arena, so it is closed first
+	DestroySpectrogram();
+	DestroyAcquisitionArena();
+
+	// Report how far the float32 phase skew was from the float64 phase skew
+	if (DFT_SINGLE_PRECISION && comparePrecision)
+		printf("Float32 phase skew error (deg): %1.2e max over %d block(s), %d block(s) over the %1.2e tolerance\n",precisionReport.maxPhaseSkewErrorDeg,precisionReport.blocks,precisionReport.blocksOverTolerance,phaseSkewToleranceDeg);
+
 	if( DAQmxFailed(error) )
 		printf("DAQmx Error: %s\n",errBuff);
 	printf("End of program, press Enter key to quit");
@@ -193,70 +347,219 @@ Error:
 int32 EveryNCallback(TaskHandle taskHandle, int32 everyNsamplesEventType, uInt32 nSamples, void *callbackData)
 {
 	int32           error=0;
-	double 			measuredPhaseSkewDeg=0,measuredPhaseSkewSec=0,measuredFreq=0;
 	char            errBuff[2048]={'\0'};
-	static int32    dsaTotalRead=0,mioTotalRead=0;
-	int32           samplesReadPerChan,dsaRead,mioRead;
-	float64         totalData[2*sampsPerChan],dsaData[sampsPerChan],mioData[sampsPerChan],timeData[sampsPerChan];
+	int32           samplesReadPerChan;
+	float64         *totalData;
+	int32           *codes;
+	AnalysisRingSlot *slot;
+
+	// Find how many samples are waiting in the DAQmx buffer, to watch its fill level and for catch-up reads
+	uInt32 available = 0;
+	if (catchUpReads || bufferFillWarning > 0)
+	{
+		DAQmxErrChk (DAQmxGetReadAvailSampPerChan(taskHandle,&available));
+		WatchInputBuffer(available);
+	}
 
-	// Implicitly cast LogsPtr type def to pointer "data"
-	LogsPtr data = (LogsPtr)callbackData;
+	// With catch-up reads, read every complete block that is waiting
+	int blocks = 1;
+	if (catchUpReads)
+	{
+		blocks = CatchUpBlocks(available);
+
+		// An earlier callback already read the block this event was raised for
+		if (blocks == 0)
+			return 0;
+	}
 
 	/*********************************************/
 	// DAQmx Read Code
 	/*********************************************/
-	DAQmxErrChk (DAQmxReadAnalogF64(taskHandle,sampsPerChan,timeout,fillMode,totalData,2*sampsPerChan,&samplesReadPerChan,NULL));
-	
-	// Assign the amount of samples read to the respective variables
-	if (samplesReadPerChan = sampsPerChan)
+	// Raw reads only transfer the codes. Scaling them is left to the analysis.
+	if (blocks > 1)
+	{
+		// Drain the backlog with one read into the batch buffers, then hand the blocks on in order
+		int32 batchSamples = blocks * sampsPerChan;
+		if (rawReads)
+			DAQmxErrChk (DAQmxReadBinaryI32(taskHandle,batchSamples,timeout,fillMode,arena.batchCodes,numChannels*batchSamples,&samplesReadPerChan,NULL));
+		else
+			DAQmxErrChk (DAQmxReadAnalogF64(taskHandle,batchSamples,timeout,fillMode,arena.batchData,numChannels*batchSamples,&samplesReadPerChan,NULL));
+
+		// The read groups the samples by channel, so channel c of block b starts at c*samplesReadPerChan + b*sampsPerChan
+		int complete = CompleteBatchBlocks(&samplesReadPerChan,1);
+		for (int b = 0; b < complete; b++)
+		{
+			slot = BlockDestination(&totalData,&codes);
+			for (uInt32 c = 0; c < numChannels; c++)
+			{
+				if (rawReads)
+					memcpy(codes + c*sampsPerChan,arena.batchCodes + c*samplesReadPerChan + b*sampsPerChan,sizeof(int32) * sampsPerChan);
+				else
+					memcpy(totalData + c*sampsPerChan,arena.batchData + c*samplesReadPerChan + b*sampsPerChan,sizeof(float64) * sampsPerChan);
+			}
+			DeliverBlock(callbackData,slot,totalData,codes,sampsPerChan);
+		}
+	}
+	else
 	{
-		dsaRead = samplesReadPerChan;
-		mioRead = samplesReadPerChan;
+		slot = BlockDestination(&totalData,&codes);
+		if (rawReads)
+			DAQmxErrChk (DAQmxReadBinaryI32(taskHandle,sampsPerChan,timeout,fillMode,codes,numChannels*sampsPerChan,&samplesReadPerChan,NULL));
+		else
+			DAQmxErrChk (DAQmxReadAnalogF64(taskHandle,sampsPerChan,timeout,fillMode,totalData,numChannels*sampsPerChan,&samplesReadPerChan,NULL));
+		DeliverBlock(callbackData,slot,totalData,codes,samplesReadPerChan);
 	}
 
-	// Split data into 2 separate arrays
-	int j = 0;
-	for (int i = 0; i < sampsPerChan; i++)
+Error:
+	if( DAQmxFailed(error) ) {
+		DAQmxGetExtendedErrorInfo(errBuff,2048);
+		/*********************************************/
+		// DAQmx Stop Code
+		/*********************************************/
+		if( taskHandle ) {
+			DAQmxStopTask(taskHandle);
+			DAQmxClearTask(taskHandle);
+		}
+		printf("DAQmx Error: %s\n",errBuff);
+	}
+	return 0;
+}
+
+// Analyses one block of samples and writes the results to the CSV files and the console. Blocks must be analysed in the order
+// they were read. codes are the raw codes the samples were scaled from, which are logged with them, or NULL.
+// spectra are the spectra an analysis worker already calculated, or NULL. skipped counts the samples
+// per channel of blocks dropped, and of partial catch-up reads, before this one, which are added to the totals.
+void AnalyzeBlock(void *callbackData, float64 *totalData, int32 *codes, DFTComplex *spectra, int32 samplesReadPerChan, int32 skipped)
+{
+	double 			measuredPhaseSkewDeg[numChannels],measuredPhaseSkewSec[numChannels],measuredFreq=0;
+	static int32    dsaTotalRead=0,mioTotalRead=0;
+	int32           dsaRead,mioRead;
+
+	// Implicitly cast LogsPtr type def to pointer "data"
+	LogsPtr data = (LogsPtr)callbackData;
+
+	// A separate DFT buffer is only needed to convert to float32 or to apply the window. It is filled in one pass right after the read.
+	int             separateDFTData = DFT_SINGLE_PRECISION || dftWindow != NULL;
+	DFTReal         *dftData = separateDFTData ? arena.dftData : (DFTReal*)totalData;
+
+	dsaTotalRead += skipped;
+	mioTotalRead += skipped;
+
+	// Print the input buffer warning the callback raised, off the callback thread
+	ReportInputBufferWarning();
+
+	// Assign the amount of samples read to the respective variables. Both devices are read by the one task.
+	dsaRead = samplesReadPerChan;
+	mioRead = samplesReadPerChan;
+
+	// Append the frames this block completes to the spectrogram
+	if (spectrogram)
 	{
-		dsaData[i] = totalData[j];
-		mioData[i] = totalData[j+1];
-		j = j + 2;
+		double *channels[numChannels];
+		for (uInt32 c = 0; c < numChannels; c++)
+			channels[c] = totalData + c*sampsPerChan;
+		SpectrogramBlock(channels,numChannels,sampsPerChan);
 	}
 
-	// Perform DFT
-	DFT(dsaData,mioData,sampleRate,sampsPerChan,data->dftData.precision,data->dftData.file,&measuredPhaseSkewDeg,&measuredPhaseSkewSec,&measuredFreq);
+	if (separateDFTData && spectra == NULL)
+		StoreData(sampsPerChan,numChannels,totalData,dftWindow,dftData);
+
+	// Perform DFT directly on the samples as read. Without a DFT plan the block is only counted.
+	if (!DFT(dftData,totalData,spectra,numChannels,sampleRate,sampsPerChan,data->dftData.precision,data->dftData.file,measuredPhaseSkewDeg,measuredPhaseSkewSec,&measuredFreq))
+	{
+		dsaTotalRead += dsaRead;
+		mioTotalRead += mioRead;
+		return;
+	}
+
+	// Update the phase skew every slidingHopSize samples within the block
+	if (slidingDFT)
+	{
+		double *channels[numChannels];
+		for (uInt32 c = 0; c < numChannels; c++)
+			channels[c] = totalData + c*sampsPerChan;
+		SlidingDFTBlock(channels,1,numChannels,sampsPerChan,(int)round(measuredFreq*sampsPerChan/sampleRate),sampleRate,data->slidingSkewData.file);
+	}
+
+	// Write the GCC-PHAT delays in whole and fractional samples to CSV
+	if (data->gccPhatData.file != NULL)
+	{
+		fprintf(data->gccPhatData.file,"%d",(int)dsaTotalRead + samplesReadPerChan);
+		for (uInt32 c = 1; c < numChannels; c++)
+		{
+			double delay = measuredPhaseSkewSec[c] * sampleRate;
+			fprintf(data->gccPhatData.file,",%d,%0.*f,%1.4e",(int)round(delay),data->gccPhatData.precision,delay-round(delay),measuredPhaseSkewSec[c]);
+		}
+		fprintf(data->gccPhatData.file,"\n");
+	}
+
+	// Write the distortion of every channel to CSV alongside its phase skew
+	if (data->harmonicData.file != NULL)
+	{
+		int precision = data->harmonicData.precision;
+		fprintf(data->harmonicData.file,"%d",(int)dsaTotalRead + samplesReadPerChan);
+		for (uInt32 c = 0; c < numChannels; c++)
+		{
+			HarmonicResult *result = &harmonicResults[c];
+			fprintf(data->harmonicData.file,",%0.*f,%0.*f,%0.*f,%0.*f,%0.*f,%1.4e",precision,result->fundamentalFreq,precision,result->thdDb,precision,result->sinadDb,precision,result->sfdrDb,precision,result->enob,measuredPhaseSkewSec[c]);
+		}
+		fprintf(data->harmonicData.file,"\n");
+	}
+
+	// Write every tone found in this block to CSV
+	if (data->multiToneData.file != NULL)
+	{
+		int precision = data->multiToneData.precision;
+		for (int t = 0; t < numDetectedTones; t++)
+		{
+			Tone *tone = &detectedTones[t];
+			fprintf(data->multiToneData.file,"%d,%d,%0.*f",(int)dsaTotalRead + samplesReadPerChan,t+1,precision,tone->freq);
+			for (uInt32 c = 0; c < numChannels; c++)
+				fprintf(data->multiToneData.file,",%0.*f",precision,tone->amplitude[c]);
+			for (uInt32 c = 1; c < numChannels; c++)
+				fprintf(data->multiToneData.file,",%0.*f,%1.4e",precision,tone->skewDeg[c],tone->skewSec[c]);
+			fprintf(data->multiToneData.file,"\n");
+		}
+	}
 
 	// Write to voltage data to CSV 
-	fprintf(data->voltageData.file,"Time (s),DSA Data (V),MIO Data (V)\n");
+	fprintf(data->voltageData.file,"Time (s)");
+	for (uInt32 c = 0; c < numChannels; c++)
+		fprintf(data->voltageData.file,",%s (V)",channelNames[c]);
+	if (codes != NULL)
+	{
+		for (uInt32 c = 0; c < numChannels; c++)
+			fprintf(data->voltageData.file,",%s (code)",channelNames[c]);
+	}
+	fprintf(data->voltageData.file,"\n");
 	for (int i = 0; i < sampsPerChan; i++)
 	{
-		// Build time array
-		timeData[i] = i * (1/sampleRate);
+		// Calculate the sample time
+		double timeData = i * (1/sampleRate);
 
 		// Print voltage data to CSV file
-		fprintf(data->voltageData.file,"%0.*f,%2.*f,%2.*f\n",data->voltageData.precision,timeData[i],data->voltageData.precision,dsaData[i],data->voltageData.precision,mioData[i]);
+		fprintf(data->voltageData.file,"%0.*f",data->voltageData.precision,timeData);
+		for (uInt32 c = 0; c < numChannels; c++)
+			fprintf(data->voltageData.file,",%2.*f",data->voltageData.precision,totalData[c*sampsPerChan+i]);
+
+		// Followed by the raw codes, so the samples can be recovered exactly
+		if (codes != NULL)
+		{
+			for (uInt32 c = 0; c < numChannels; c++)
+				fprintf(data->voltageData.file,",%d",(int)codes[c*sampsPerChan+i]);
+		}
+		fprintf(data->voltageData.file,"\n");
 	}
 	// Calculate and print sample acquisition totals and DFT information
 	if( dsaRead>0 )
 		dsaTotalRead += dsaRead;
 	if( mioRead>0 )
 		mioTotalRead += mioRead;
-	printf("%d\t\t\t%d\t\t\t%5.0f\t\t\t\t\t%2.2f\t\t\t%1.2e\r", (int)dsaTotalRead,(int)mioTotalRead, measuredFreq, measuredPhaseSkewDeg, measuredPhaseSkewSec);
+	printf("%d\t\t\t%d\t\t\t%5.0f\t\t\t\t\t%2.2f\t\t\t%1.2e", (int)dsaTotalRead,(int)mioTotalRead, measuredFreq, measuredPhaseSkewDeg[1], measuredPhaseSkewSec[1]);
+	for (uInt32 c = 2; c < numChannels; c++)
+		printf("\t\t\t%2.2f\t\t\t%1.2e",measuredPhaseSkewDeg[c],measuredPhaseSkewSec[c]);
+	printf("\r");
 	fflush(stdout);
-
-Error:
-	if( DAQmxFailed(error) ) {
-		DAQmxGetExtendedErrorInfo(errBuff,2048);
-		/*********************************************/
-		// DAQmx Stop Code
-		/*********************************************/
-		if( taskHandle ) {
-			DAQmxStopTask(taskHandle);
-			DAQmxClearTask(taskHandle);
-		}
-		printf("DAQmx Error: %s\n",errBuff);
-	}
-	return 0;
 }
 
 int32 DoneCallback(TaskHandle taskHandle, int32 status, void *callbackData)
@@ -272,6 +575,14 @@ int32 DoneCallback(TaskHandle taskHandle, int32 status, void *callbackData)
 	// Close CSV files
 	fclose(data->voltageData.file);
 	fclose(data->dftData.file);
+	if (data->slidingSkewData.file != NULL)
+		fclose(data->slidingSkewData.file);
+	if (data->gccPhatData.file != NULL)
+		fclose(data->gccPhatData.file);
+	if (data->harmonicData.file != NULL)
+		fclose(data->harmonicData.file);
+	if (data->multiToneData.file != NULL)
+		fclose(data->multiToneData.file);
 
 Error:
 	if( DAQmxFailed(error) ) {
@@ -287,8 +598,12 @@ Error:
 	return 0;
 }
 
-// Calculates a discrete Fourier transform using the FFTW libary
-void DFT(double *dsaData, double *mioData, double sampleRate, long long int sampsPerChan, int precision, FILE *file, double *measuredPhaseSkewDeg, double *measuredPhaseSkewSec, double *measuredFreq)
+// Calculates a discrete Fourier transform of every channel in the GroupByChannel data using the FFTW libary.
+// The phase skew of each channel is measured relative to the first (DSA) channel. "sourceData" holds the samples
+// as read from DAQmx and is only used to compare single precision results against double precision. The transform
+// is skipped if an analysis worker already calculated the spectra into "workerSpectra". Returns 0, without measuring
+// the block, if the DFT plan cache had no plan for it.
+int DFT(DFTReal *data, double *sourceData, DFTComplex *workerSpectra, int numChannels, double sampleRate, long long int sampsPerChan, int precision, FILE *file, double *measuredPhaseSkewDeg, double *measuredPhaseSkewSec, double *measuredFreq)
 {
 	
 	// Calculate in and out array sizes
@@ -298,112 +613,271 @@ void DFT(double *dsaData, double *mioData, double sampleRate, long long int samp
 	// Calculate maximum precision of frequency bins
 	double binPrecision = sampleRate/sampsPerChan;
 
-	// Instantiate variables for FFTW
-	double *dsaInput, *mioInput;
-	fftw_complex *dsaOutput, *mioOutput;
-	fftw_plan dsaDFT, mioDFT;
+	// Instantiate variables for FFTW. The spectrum of channel c starts at output[c*nc].
+	DFTComplex *output = workerSpectra != NULL ? workerSpectra : arena.output;
+	DFTPlan plan;
 
-	// Allocated input and output arrays
-	dsaInput = (double*)fftw_malloc(sizeof(double) * n);
-	mioInput = (double*)fftw_malloc(sizeof(double) * n);
-	dsaOutput = (fftw_complex*)fftw_malloc(sizeof(fftw_complex) * nc);
-	mioOutput = (fftw_complex*)fftw_malloc(sizeof(fftw_complex) * nc);
+	// The evaluated bins of channel c are stored from output[c*nc]. Without tone tracking this is the full spectrum.
+	int firstBin = 0;
+	int numBins = nc;
 
-	// Store real data in the input arrays
-	StoreData(n,dsaData,dsaInput);
-	StoreData(n,mioData,mioInput);
+	// While a stable tone is tracked, evaluate only the tracked bin and its neighbours
+	if (workerSpectra == NULL && toneTracking && toneTracker.locked && !gccPhatEstimator && !harmonicAnalysis && !multiToneDetection)
+	{
+		firstBin = toneTracker.bin - trackingNeighbourBins > 0 ? toneTracker.bin - trackingNeighbourBins : 0;
+		numBins = (toneTracker.bin + trackingNeighbourBins < nc ? toneTracker.bin + trackingNeighbourBins : nc - 1) - firstBin + 1;
+		DFTComplex *trackedSpectra[numChannels];
+		for (int c = 0; c < numChannels; c++)
+		{
+			trackedSpectra[c] = output + c*nc;
+			GoertzelBins(sourceData+c*n,dftWindow,1,n,firstBin,numBins,trackedSpectra[c]);
+		}
 
-	// Instantiate plan for a 1D DFT of the real data
-	dsaDFT = fftw_plan_dft_r2c_1d(n,dsaInput,dsaOutput,FFTW_ESTIMATE);
-	mioDFT = fftw_plan_dft_r2c_1d(n,mioInput,mioOutput,FFTW_ESTIMATE);
+		// Fall back to the full DFT of this block if the tone has moved
+		if (!ToneStillTracked(trackedSpectra,numChannels,firstBin,numBins))
+		{
+			firstBin = 0;
+			numBins = nc;
+		}
+	}
 
-	// Execute the DFTs
-	fftw_execute(dsaDFT);
-	fftw_execute(mioDFT);
+	if (numBins == nc && workerSpectra == NULL)
+	{
+		// Look up the batched plan created at startup. It reads every channel straight
+		// from the contiguous block DAQmx read it into, so no copies are made.
+		plan = GetDFTPlan(n,numChannels,0,data,output);
+		if (plan == NULL)
+			return 0;
+
+		// Execute the DFTs of all channels
+		ExecuteDFT(plan,data,output);
+	}
 	
-	// Open CSV file
-	fprintf(file,"Frequency (Hz),DSA Magnitude,DSA Amplitude (V),MIO Magnitude,MIO Amplitude (V)\n");
-
-	// Insantiate variables to track the frequency in a measured signal
-	int maxMagnitudeIndex = 0;
-	int maxMagnitude = 0;
-
-	// Calculate and store the frequency components
-	for (int i = 0; i < nc; i++)
-	{	
-		// Allocate the real and imaginary DFT components of each frequency to variables
-		double dsaRealComp = dsaOutput[i][REAL];
-		double dsaImagComp = dsaOutput[i][IMAG];
-		double mioRealComp = mioOutput[i][REAL];
-		double mioImagComp = mioOutput[i][IMAG];
-		
-		// Calculate the frequency, magnitude, and amplitude from the DFT data
-		double freq = i * binPrecision;
-		double dsaMagnitude = sqrt((dsaRealComp*dsaRealComp) + (dsaImagComp*dsaImagComp));
-		double mioMagnitude = sqrt((mioRealComp*mioRealComp) + (mioImagComp*mioImagComp));
-		double dsaAmplitude = dsaMagnitude * 2 / n;
-		double mioAmplitude = mioMagnitude * 2 / n;
-
-		// Write DFT data to CSV file
-		fprintf(file,"%5.2f,%5.*f,%5.*f,%5.*f,%5.*f\n",freq,precision,dsaMagnitude,precision,dsaAmplitude,precision,mioMagnitude,precision,mioAmplitude);
-
-		// Find at which frequency bin the highest magnitude exists
-		if ( dsaMagnitude >= maxMagnitude && mioMagnitude >= maxMagnitude)
+	// Calculate the magnitude and amplitude of every bin of every channel and find the bin at which all channels are strongest
+	DFTComplex *spectra[numChannels];
+	DFTReal *magnitudes[numChannels], *amplitudes[numChannels];
+	for (int c = 0; c < numChannels; c++)
+	{
+		spectra[c] = output + c*nc;
+		magnitudes[c] = arena.magnitudes + c*nc;
+		amplitudes[c] = arena.amplitudes + c*nc;
+	}
+	int maxMagnitudeIndex = firstBin + SpectrumKernel(spectra,numChannels,numBins,2 / (n * dftWindowCoherentGain),logSpectrum ? magnitudes : NULL,amplitudes);
+
+	// Measure the distortion of every channel from the same spectra
+	if (harmonicAnalysis)
+	{
+		for (int c = 0; c < numChannels; c++)
+			AnalyzeHarmonics(spectra[c],n,maxMagnitudeIndex,binPrecision,(maxVal - minVal) / 2,&harmonicResults[c]);
+	}
+
+	// Find every tone and its phase skew in the same spectra
+	if (multiToneDetection)
+		DetectTones(spectra,numChannels,n,binPrecision);
+
+	// Write DFT data to CSV file. Tone amplitudes are corrected by the coherent gain of the window and noise densities by its noise power gain.
+	if (logSpectrum)
+	{
+		double densityScale = sqrt(2 / (sampleRate * n * dftWindowNoiseGain));
+		fprintf(file,"Frequency (Hz)");
+		for (int c = 0; c < numChannels; c++)
+			fprintf(file,",%s Magnitude,%s Amplitude (V),%s Noise Density (V/rtHz)",channelNames[c],channelNames[c],channelNames[c]);
+		fprintf(file,"\n");
+		for (int i = 0; i < numBins; i++)
 		{
-			maxMagnitude = dsaMagnitude;
-			maxMagnitudeIndex = i;
+			fprintf(file,"%5.2f",(firstBin + i) * binPrecision);
+			for (int c = 0; c < numChannels; c++)
+				fprintf(file,",%5.*f,%5.*f,%1.4e",precision,magnitudes[c][i],precision,amplitudes[c][i],magnitudes[c][i]*densityScale);
+			fprintf(file,"\n");
 		}
 	}
 
-	// Assign variables for real and imaginary components at the maximum frequency
-	double dsaMaxRealComp = dsaOutput[maxMagnitudeIndex][REAL];
-	double dsaMaxImagComp = dsaOutput[maxMagnitudeIndex][IMAG];
-	double mioMaxRealComp = mioOutput[maxMagnitudeIndex][REAL];
-	double mioMaxImagComp = mioOutput[maxMagnitudeIndex][IMAG];
-
 	// Calculate frequency of measured signal
 	double maxFreq = maxMagnitudeIndex * binPrecision;
 
-	// Calculate phase
-	double dsaPhase = atan2(dsaMaxImagComp,dsaMaxRealComp) * (180/PI);
-	double mioPhase = atan2(mioMaxImagComp,mioMaxRealComp) * (180/PI);
+	// Interpolate the tone frequency between bins. The phases are corrected for the offset from the bin centre below.
+	int maxOffset = maxMagnitudeIndex - firstBin;
+	double delta = 0;
+	if (interpolatedEstimator && maxMagnitudeIndex > firstBin && maxMagnitudeIndex < firstBin + numBins - 1)
+	{
+		double below = 0, peak = 0, above = 0;
+		for (int c = 0; c < numChannels; c++)
+		{
+			below += BinMagnitude(output[c*nc+maxOffset-1]);
+			peak += BinMagnitude(output[c*nc+maxOffset]);
+			above += BinMagnitude(output[c*nc+maxOffset+1]);
+		}
+		delta = InterpolateHannPeak(below,peak,above);
+		maxFreq = (maxMagnitudeIndex + delta) * binPrecision;
+	}
 
-	// Calculate phase skew between DSA and MIO device
-	double phaseSkewDeg = NormalizePhaseAngleDifference(dsaPhase-mioPhase); // phase skew in degrees
-	double phaseSkewSec = ((dsaPhase-mioPhase)/360) * (1/maxFreq); // phase skew in seconds
+	// Zoom in on the band around the peak bin and take the frequency and phases where the tone is strongest
+	double zoomPhase[numChannels];
+	int zoomed = 0;
+	if (zoomFFT)
+	{
+		double *channels[numChannels];
+		for (int c = 0; c < numChannels; c++)
+			channels[c] = sourceData + c*n;
+		zoomed = ZoomTone(channels,numChannels,maxMagnitudeIndex,binPrecision,&maxFreq,zoomPhase);
+	}
+
+	// Calculate phase of the DSA channel at the maximum frequency
+	double dsaPhase = zoomed ? zoomPhase[0] : atan2(output[maxOffset][IMAG],output[maxOffset][REAL]) * (180/PI) - 180 * delta;
+
+	// Start tracking the tone once it has stayed in the same bin
+	if (toneTracking)
+		UpdateToneTracker(maxMagnitudeIndex,sqrt((output[maxOffset][REAL]*output[maxOffset][REAL]) + (output[maxOffset][IMAG]*output[maxOffset][IMAG])));
+
+	// Add this block to the averaged spectra
+	if (welchAveraging || groupDelayEstimator)
+	{
+		DFTComplex *outputs[numChannels];
+		for (int c = 0; c < numChannels; c++)
+			outputs[c] = output + c*nc;
+		WelchAccumulate(outputs,firstBin,numBins);
+	}
+
+	// Measure the delay of every channel from the PHAT weighted cross-correlation
+	double gccPhatDelays[numChannels];
+	int gccPhatMeasured = 0;
+	if (gccPhatEstimator && numChannels > 1)
+	{
+		DFTComplex *outputs[numChannels];
+		for (int c = 0; c < numChannels; c++)
+			outputs[c] = output + c*nc;
+		gccPhatMeasured = GccPhatDelays(outputs,numChannels,n,gccPhatDelays);
+	}
+
+	// Calculate phase skew between the DSA channel and every channel
+	int checkPrecision = DFT_SINGLE_PRECISION && comparePrecision && PrecisionCheckDue();
+	for (int c = 0; c < numChannels; c++)
+	{
+		double phase = zoomed ? zoomPhase[c] : atan2(output[c*nc+maxOffset][IMAG],output[c*nc+maxOffset][REAL]) * (180/PI) - 180 * delta;
+		measuredPhaseSkewDeg[c] = NormalizePhaseAngleDifference(dsaPhase-phase); // phase skew in degrees
+		measuredPhaseSkewSec[c] = ((dsaPhase-phase)/360) * (1/maxFreq); // phase skew in seconds
+
+		// Compare against the phase skew calculated in float64 from the samples as read
+		if (checkPrecision && c > 0)
+			ComparePhaseSkewPrecision(sourceData,sourceData+c*n,1,n,maxMagnitudeIndex,measuredPhaseSkewDeg[c]);
+
+		// Report the phase skew of the averaged cross-spectrum instead
+		if (welchAveraging)
+		{
+			measuredPhaseSkewDeg[c] = WelchPhaseSkewDeg(c,maxMagnitudeIndex);
+			measuredPhaseSkewSec[c] = (measuredPhaseSkewDeg[c]/360) * (1/maxFreq);
+		}
+
+		// Report the skew fitted over every coherent bin if any bins passed the thresholds
+		double skewSec;
+		if (groupDelayEstimator && c > 0 && GroupDelaySkewSec(c,binPrecision,&skewSec) > 0)
+		{
+			measuredPhaseSkewSec[c] = skewSec;
+			measuredPhaseSkewDeg[c] = NormalizePhaseAngleDifference(skewSec * 360 * maxFreq);
+		}
+
+		// Report the GCC-PHAT delay
+		if (gccPhatMeasured && c > 0)
+		{
+			measuredPhaseSkewSec[c] = gccPhatDelays[c] / sampleRate;
+			measuredPhaseSkewDeg[c] = NormalizePhaseAngleDifference(measuredPhaseSkewSec[c] * 360 * maxFreq);
+		}
+	}
 
 	// Assign values to be displayed on the console
-	*measuredPhaseSkewDeg = phaseSkewDeg;
-	*measuredPhaseSkewSec = phaseSkewSec;
 	*measuredFreq = maxFreq;
+	return 1;
+}
 
-	// Free the resources
-	fftw_destroy_plan(dsaDFT);
-	fftw_destroy_plan(mioDFT);
-	fftw_free(dsaInput); 
-	fftw_free(dsaOutput);
-	fftw_free(mioInput); 
-	fftw_free(mioOutput);
+// Carves every buffer used on the acquisition path out of the arena. Without an allocated block it only adds up their sizes.
+void CarveAcquisitionArena(int length, int channels)
+{
+	int nc = (length/2)+1;
+	arena.totalData = (float64*)ArenaAlloc(sizeof(float64) * length * channels);
+	if (rawReads)
+		arena.codes = (int32*)ArenaAlloc(sizeof(int32) * length * channels);
+	if (DFT_SINGLE_PRECISION || dftWindow != NULL)
+		arena.dftData = (DFTReal*)ArenaAlloc(sizeof(DFTReal) * length * channels);
+	arena.output = (DFTComplex*)ArenaAlloc(sizeof(DFTComplex) * nc * channels);
+	arena.magnitudes = (DFTReal*)ArenaAlloc(sizeof(DFTReal) * nc * channels);
+	arena.amplitudes = (DFTReal*)ArenaAlloc(sizeof(DFTReal) * nc * channels);
+	if (catchUpReads && rawReads)
+		arena.batchCodes = (int32*)ArenaAlloc(sizeof(int32) * length * channels * maxCatchUpBlocks);
+	else if (catchUpReads)
+		arena.batchData = (float64*)ArenaAlloc(sizeof(float64) * length * channels * maxCatchUpBlocks);
+
+	// The analysis buffers and the analysis ring, with the channels of a slot laid out like totalData for the batched plan
+	CarveAnalysisBuffers(length,channels);
+	CarveAnalysisRing(length,channels,0);
 }
 
-// Stores voltage data in arrays of real data to be used in the DFT
-void StoreData(int arraySize, double *dataToAllocate, double *output)
+// Calculates the spectra of every channel of a block into its slot. Runs on an analysis worker, so it only writes the slot's buffers.
+void TransformBlock(AnalysisRingSlot *slot)
 {
-	// Store data in new array
-	for (int i = 0; i < arraySize; i++)
+	int n = sampsPerChan;
+
+	// The codes are scaled here, ahead of the analysis thread
+	if (rawReads)
+		ScaleRawBlock(slot->codes,slot->data);
+
+	// The DFT reads the samples directly unless they have to be converted to float32 or windowed first
+	DFTReal *input = (DFTReal*)slot->data;
+	if (slot->input != NULL)
 	{
-		output[i] = dataToAllocate[i];
+		input = slot->input;
+		StoreData(n,numChannels,slot->data,dftWindow,input);
 	}
+
+	// Every slot buffer has the same alignment as the arena buffers, so the batched plan created at startup is used.
+	// Without a plan the block is left to the analysis thread, which skips it the same way.
+	DFTPlan plan = GetDFTPlan(n,numChannels,0,input,slot->output);
+	slot->hasSpectra = plan != NULL;
+	if (plan != NULL)
+		ExecuteDFT(plan,input,slot->output);
 }
 
-// Ensures the phase angle is between -180 deg and 180 deg
-double NormalizePhaseAngleDifference(double phase)
+// Analyses the block in a ring slot on the analysis thread. The codes are scaled here unless an analysis worker already scaled them.
+void AnalyzeRingSlot(void *callbackData, AnalysisRingSlot *slot)
 {
-	if (phase > 270)
-		phase = phase - 360;
-	
-	if (phase < -90)
-		phase = phase + 360;
+	int workers = AnalysisWorkerCount();
+	if (rawReads && workers == 0)
+		ScaleRawBlock(slot->codes,slot->data);
+	AnalyzeBlock(callbackData,slot->data,slot->codes,workers > 0 && slot->hasSpectra ? slot->output : NULL,slot->read[0],slot->skipped[0]);
+}
 
-	return phase;
-}
\ No newline at end of file
+// Points the buffers at the ring slot the next block is read into and returns the slot. Without the analysis thread, or if every
+// slot is still waiting, they are pointed at the arena instead and NULL is returned. The block is then dropped by the ring.
+// The batched DFT plan reads the samples of every channel straight from the arena buffer.
+AnalysisRingSlot *BlockDestination(float64 **totalData, int32 **codes)
+{
+	AnalysisRingSlot *slot = analysisThread ? NextFreeRingSlot() : NULL;
+	*totalData = slot != NULL ? slot->data : arena.totalData;
+	*codes = slot != NULL ? slot->codes : arena.codes;
+	return slot;
+}
+
+// Hands a block that has been read to the analysis thread, or analyses it on this thread if there is none
+void DeliverBlock(void *callbackData, AnalysisRingSlot *slot, float64 *totalData, int32 *codes, int32 samplesReadPerChan)
+{
+	if (analysisThread)
+	{
+		int32 read[MAX_TASKS] = {samplesReadPerChan};
+		PublishRingSlot(slot,read);
+	}
+	else
+	{
+		// Without the analysis thread the codes are scaled on this thread
+		if (rawReads)
+			ScaleRawBlock(codes,totalData);
+		int32 skipped[MAX_TASKS];
+		TakeSkippedSamples(skipped);
+		AnalyzeBlock(callbackData,totalData,rawReads ? codes : NULL,NULL,samplesReadPerChan,skipped[0]);
+	}
+}
+
+// Scales the raw codes of every channel of a block to volts. Channel c starts at codes[c*sampsPerChan], as in data.
+void ScaleRawBlock(int32 *codes, float64 *data)
+{
+	for (uInt32 c = 0; c < numChannels; c++)
+		ScaleRawCodes(codes + c*sampsPerChan,&rawScaling[c],sampsPerChan,data + c*sampsPerChan);
+}
@@ -59,22 +59,29 @@
 
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <NIDAQmx.h>
 #include <math.h>
-#include <fftw3.h>
+#include "SyncCommon.h"
 
 static TaskHandle DSATaskHandle=0, MIOTaskHandle=0;
 
 #define DAQmxErrChk(functionCall) if( DAQmxFailed(error=(functionCall)) ) goto Error; else
-#define REAL 0
-#define IMAG 1
-#define PI 3.14159265
+
+// Raw reads
+// Scaling of each channel, see RawScaling in SyncCommon.h
+static RawScaling rawScaling[2]; // DSA and MIO channels
 
 int32 EveryNCallback(TaskHandle taskHandle, int32 everyNsamplesEventType, uInt32 nSamples, void *callbackData);
 int32 DoneCallback(TaskHandle taskHandle, int32 status, void *callbackData);
-void DFT(double *dsaData, double *mioData, double sampleRate, long long int sampsPerChan, int precision, FILE *file, double *measuredPhaseSkewDeg, double *measuredPhaseSkewSec, double *measuredFreq);
-void StoreData(int arraySize, double *dataToAllocate, double *output);
-double NormalizePhaseAngleDifference(double phase);
+int DFT(double *dsaData, double *mioData, DFTComplex *dsaSpectrum, DFTComplex *mioSpectrum, double sampleRate, long long int sampsPerChan, int precision, FILE *file, double *measuredPhaseSkewDeg, double *measuredPhaseSkewSec, double *measuredFreq);
+void CarveAcquisitionArena(int length, int channels);
+void AnalyzeBlock(void *callbackData, float64 *dsaData, float64 *mioData, int32 *dsaCodes, int32 *mioCodes, DFTComplex *dsaSpectrum, DFTComplex *mioSpectrum, int32 dsaRead, int32 mioRead, int32 dsaSkipped, int32 mioSkipped);
+void AnalyzeRingSlot(void *callbackData, AnalysisRingSlot *slot);
+void TransformBlock(AnalysisRingSlot *slot);
+AnalysisRingSlot *BlockDestination(float64 **dsaData, float64 **mioData, int32 **dsaCodes, int32 **mioCodes);
+void DeliverBlock(void *callbackData, AnalysisRingSlot *slot, float64 *dsaData, float64 *mioData, int32 *dsaCodes, int32 *mioCodes, int32 dsaRead, int32 mioRead);
+void ScaleRawBlock(int32 *dsaCodes, int32 *mioCodes, float64 *dsaData, float64 *mioData);
 
 /*********************************************/
 // DAQmx Configuration Options
@@ -118,11 +125,15 @@ const uInt32 options = 0; // Use this parameter to set certain options. Pass a v
 const float64 timeout = 10.0; // The amount of time, in seconds, to wait for the function to read the sample(s).
 const bool32 fillMode = DAQmx_Val_GroupByChannel; // Specifies whether or not the samples are interleaved. Options: DAQmx_Val_GroupByChannel, DAQmx_Val_GroupByScanNumber
 
-// CSV file creation options
-const char *voltageDataFileName = "../../VoltageData.csv"; // Measurement data is stored in this CSV file
-const char *dftDataFileName = "../../DFTData.csv"; // DFT data is stored in this CSV file
-const int voltageDataFileLogPrecision = 2; // Precision at which to store the voltage data
-const int dftDataFileLogPrecision = 3; // Precision at which to store the dft data
+/*********************************************/
+// Program Options
+/*********************************************/
+// The analysis options shared by all three programs are set in SyncCommon/src/SyncOptions.c
+
+// Channel DFT Options
+const int concurrentChannelDFTs = 0; // Options: 1 (transform the MIO channel on a worker thread while the callback thread transforms the DSA channel), 0 (transform the channels one after the other)
+
+// CSV files
 typedef struct {
 	FILE *file;
 	int precision;
@@ -130,15 +141,37 @@ typedef struct {
 typedef struct {
 	LogFile voltageData;
 	LogFile dftData;
+	LogFile slidingSkewData; // Only opened when slidingDFT is enabled
+	LogFile gccPhatData; // Only opened when gccPhatEstimator is enabled
+	LogFile harmonicData; // Only opened when harmonicAnalysis is enabled
+	LogFile multiToneData; // Only opened when multiToneDetection is enabled
 } Logs;
 typedef Logs *LogsPtr;
 
+// Acquisition arena buffers
+// The sample and spectrum buffers of this program, carved out of the acquisition arena by CarveAcquisitionArena()
+typedef struct {
+	int directInput; // Nonzero if DAQmx reads straight into the DFT input
+	int inPlace; // Nonzero if the spectra are written over the samples
+	float64 *dsaData, *mioData; // Samples as read from DAQmx, with room for length/2+1 complex values
+	int32 *dsaCodes, *mioCodes; // Raw reads only: codes read from DAQmx without a ring slot
+	DFTReal *dsaInput, *mioInput; // DFT input: the samples themselves, or a converted and windowed copy
+	DFTComplex *dsaOutput, *mioOutput; // Spectra: over the samples, or separate buffers
+	DFTReal *magnitudes, *amplitudes; // Magnitudes and amplitudes of every bin, DSA then MIO
+	float64 *batchData; // Catch-up reads only: samples of up to maxCatchUpBlocks blocks, laid out as DAQmx reads them
+	int32 *batchCodes; // Catch-up and raw reads only: codes of up to maxCatchUpBlocks blocks, laid out like batchData
+} AcquisitionArena;
+static AcquisitionArena arena;
+
+// Harmonic analysis results of the latest block, one per channel
+static HarmonicResult harmonicResults[2];
+
 int main(void)
 {
 	int32       error=0;
 	char        errBuff[2048]={'\0'};
 	char	    trigName[256];
-	LogFile 	voltageDataFile, dftDataFile;
+	LogFile 	voltageDataFile, dftDataFile, slidingSkewDataFile, gccPhatDataFile, harmonicDataFile, multiToneDataFile;
 	Logs		logData;
 
  	/*********************************************/
@@ -159,19 +192,78 @@ int main(void)
 	DAQmxErrChk (DAQmxGetStartTrigTerm(DSATaskHandle,trigName,sizeof(trigName)));
 	DAQmxErrChk (DAQmxCfgDigEdgeStartTrig(MIOTaskHandle,trigName,DAQmx_Val_Rising));
 
+	// Fetch the polynomials that scale the raw codes to volts
+	if (rawReads)
+	{
+		DAQmxErrChk (InitRawScaling(DSATaskHandle,physicalChannelDSA,&rawScaling[0]));
+		DAQmxErrChk (InitRawScaling(MIOTaskHandle,physicalChannelMIO,&rawScaling[1]));
+	}
+
+	// Size the input buffers for the stall budget
+	TaskHandle tasks[2] = {DSATaskHandle,MIOTaskHandle};
+	DAQmxErrChk (ConfigureInputBuffers(tasks,2,2));
+
 	// Create two CSV files and set precision
 	voltageDataFile.file = fopen(voltageDataFileName, "w");
 	dftDataFile.file = fopen(dftDataFileName, "w");
 	voltageDataFile.precision = voltageDataFileLogPrecision;
 	dftDataFile.precision = dftDataFileLogPrecision;
 
+	// Create the sliding phase skew CSV file if it is used
+	slidingSkewDataFile.file = slidingDFT ? fopen(slidingSkewDataFileName, "w") : NULL;
+	slidingSkewDataFile.precision = dftDataFileLogPrecision;
+	if (slidingSkewDataFile.file != NULL)
+		fprintf(slidingSkewDataFile.file,"Time (s),Frequency (Hz),Phase Skew (deg),Phase Skew (sec)\n");
+
+	// Create the GCC-PHAT delay CSV file if it is used
+	gccPhatDataFile.file = gccPhatEstimator ? fopen(gccPhatDataFileName, "w") : NULL;
+	gccPhatDataFile.precision = dftDataFileLogPrecision;
+	if (gccPhatDataFile.file != NULL)
+		fprintf(gccPhatDataFile.file,"DSA Samples Acquired,Integer Delay (samples),Fractional Delay (samples),Delay (sec)\n");
+
+	// Create the harmonic analysis CSV file if it is used
+	harmonicDataFile.file = harmonicAnalysis ? fopen(harmonicDataFileName, "w") : NULL;
+	harmonicDataFile.precision = dftDataFileLogPrecision;
+	if (harmonicDataFile.file != NULL)
+		fprintf(harmonicDataFile.file,"DSA Samples Acquired,DSA Fundamental (Hz),DSA THD (dB),DSA SINAD (dB),DSA SFDR (dBc),DSA ENOB (bits),MIO Fundamental (Hz),MIO THD (dB),MIO SINAD (dB),MIO SFDR (dBc),MIO ENOB (bits),Phase Shift (sec)\n");
+
+	// Create the multi-tone CSV file if it is used
+	multiToneDataFile.file = multiToneDetection ? fopen(multiToneDataFileName, "w") : NULL;
+	multiToneDataFile.precision = dftDataFileLogPrecision;
+	if (multiToneDataFile.file != NULL)
+		fprintf(multiToneDataFile.file,"DSA Samples Acquired,Tone,Frequency (Hz),DSA Amplitude (V),MIO Amplitude (V),Phase Shift (deg),Phase Shift (sec)\n");
+
 	// Store information in a single struct
 	logData.voltageData = voltageDataFile;
 	logData.dftData = dftDataFile;
+	logData.slidingSkewData = slidingSkewDataFile;
+	logData.gccPhatData = gccPhatDataFile;
+	logData.harmonicData = harmonicDataFile;
+	logData.multiToneData = multiToneDataFile;
 	
 	DAQmxErrChk (DAQmxRegisterEveryNSamplesEvent(DSATaskHandle,everyNsamplesEventType,sampsPerChan,options,EveryNCallback,&logData));
 	DAQmxErrChk (DAQmxRegisterDoneEvent(DSATaskHandle,0,DoneCallback,&logData));
 
+	// Create the DFT window and plans before the first callback can run
+	InitDFTWindow(sampsPerChan);
+	InitDFTThreads();
+	if (concurrentChannelDFTs)
+		InitChannelDFTWorker();
+	if (dftThreadBenchmark)
+		RunDFTThreadBenchmark(sampsPerChan,1);
+	if (spectrumKernelBenchmark)
+		RunSpectrumKernelBenchmark(2);
+	InitAcquisitionArena(CarveAcquisitionArena,sampsPerChan,2);
+	if (zoomFFT)
+		InitZoomFFT();
+	if (spectrogram)
+		InitSpectrogram(sampsPerChan,2,sampleRate);
+	// Without every startup plan in the cache the blocks could not be analysed, so the program stops before acquiring
+	if (InitDFTPlanCache(sampsPerChan,1,arena.dsaInput,arena.dsaOutput) != 0)
+		goto Error;
+	if (analysisThread)
+		InitAnalysisRing(&logData,AnalyzeRingSlot,TransformBlock);
+
 	/*********************************************/
 	// DAQmx Start Code
 	/*********************************************/
@@ -184,7 +276,12 @@ int main(void)
 	printf("Acquiring samples continuously. Press Enter to interrupt.\n");
 	printf("*********************************************************\n\n");
 	printf("Sample rate (Hz): %6.2f\n", sampleRate);
-	printf("Samples per channel: %llu\n\n", sampsPerChan);
+	printf("Samples per channel: %llu\n", sampsPerChan);
+	printf("DFT precision: %s\n", DFT_SINGLE_PRECISION ? "float32" : "float64");
+	if (welchAveraging)
+		printf("Phase skew averaging: %s\n", welchAveraging == 1 ? "exponential" : "fixed window");
+	ReportDFTBackends();
+	printf("DFT planning (s): %1.3f (%d plan(s) from wisdom, %d measured)\n\n", dftPlanCache.planningTimeSec, dftPlanCache.plansFromWisdom, dftPlanCache.plansMeasured);
 	printf("DSA Samples Acquired\tMIO Samples Acquired\tDetected Signal Frequency (Hz)\t\tPhase Shift (deg)\tPhase Shift (sec)\n");
 	getchar();
 
@@ -206,6 +303,38 @@ Error:
 		MIOTaskHandle = 0;
 	}
 
+	// Let the analysis thread finish the blocks still in the ring
+	DestroyAnalysisRing();
+
+	// Report how many DFT plans were created and free them
+	printf("\nDFT plans created at startup: %d, during acquisition: %d\n",dftPlanCache.plansCreatedAtStartup,dftPlanCache.plansCreatedDuringAcquisition);
+	if (dftPlanCache.plansRefused > 0)
+		printf("WARNING: %d DFT plan lookup(s) found the cache full and their work was skipped\n",dftPlanCache.plansRefused);
+	DestroyChannelDFTWorker();
+	DestroyDFTPlanCache();
+	DestroyDFTThreads();
+	FFTW(free)(dftWindow);
+
+	// Planning allocates memory, so a plan created during acquisition means a callback allocated
+	printf("Acquisition arena (bytes): %zu\n",arenaAllocator.size);
+	if (dftPlanCache.plansCreatedDuringAcquisition > 0)
+		printf("WARNING: memory was allocated while acquiring\n");
+	if (analysisThread)
+		printf("Analysis ring (blocks): mean occupancy %1.2f, high-water mark %u of %d, %u dropped\n",analysisRing.head > 0 ? (double)analysisRing.occupancySum / analysisRing.head : 0.0,analysisRing.highWater,analysisRingSlots,analysisRing.dropped);
+	if (AnalysisWorkerCount() > 0)
+		printf("Analysis workers: %d, blocks finished out of order: %u\n",AnalysisWorkerCount(),analysisRing.reordered);
+	if (inputBuffer.size > 0 && (catchUpReads || bufferFillWarning > 0))
+		printf("Input buffer fill (samples per channel): peak %u of %u (%1.0f%%), %u warning(s)\n",(unsigned)inputBuffer.peakFill,(unsigned)inputBuffer.size,100.0 * inputBuffer.peakFill / inputBuffer.size,inputBuffer.warnings);
+	if (catchUpReads)
+		printf("Catch-up reads (blocks): mean backlog %1.2f, largest backlog %d, %u batched read(s) of %u block(s), %u read(s) left a backlog behind\n",catchUp.callbacks > 0 ? (double)catchUp.backlogSum / catchUp.callbacks : 0.0,catchUp.maxBacklog,catchUp.batches,catchUp.batchedBlocks,catchUp.leftBehind);
+	// The spectrogram file's stdio buffer is carved from the arena, so it is closed first
+	DestroySpectrogram();
+	DestroyAcquisitionArena();
+
+	// Report how far the float32 phase skew was from the float64 phase skew
+	if (DFT_SINGLE_PRECISION && comparePrecision)
+		printf("Float32 phase skew error (deg): %1.2e max over %d block(s), %d block(s) over the %1.2e tolerance\n",precisionReport.maxPhaseSkewErrorDeg,precisionReport.blocks,precisionReport.blocksOverTolerance,phaseSkewToleranceDeg);
+
 	if( DAQmxFailed(error) )
 		printf("DAQmx Error: %s\n",errBuff);
 	printf("\nEnd of program, press Enter key to quit\n");
@@ -216,42 +345,83 @@ Error:
 int32 EveryNCallback(TaskHandle taskHandle, int32 everyNsamplesEventType, uInt32 nSamples, void *callbackData)
 {
 	int32           error=0;
-	double 			measuredPhaseSkewDeg=0,measuredPhaseSkewSec=0,measuredFreq=0;
 	char            errBuff[2048]={'\0'};
-	static int32    dsaTotalRead=0,mioTotalRead=0;
 	int32           dsaRead,mioRead;
-	float64         dsaData[sampsPerChan],mioData[sampsPerChan],timeData[sampsPerChan];
+	float64         *dsaData,*mioData;
+	int32           *dsaCodes,*mioCodes;
+	AnalysisRingSlot *slot;
+
+	// Find how many samples are waiting in the DAQmx buffer, to watch its fill level and for catch-up reads.
+	// The MIO task is sampled in step with the DSA task, so it has as many waiting.
+	uInt32 available = 0;
+	if (catchUpReads || bufferFillWarning > 0)
+	{
+		DAQmxErrChk (DAQmxGetReadAvailSampPerChan(DSATaskHandle,&available));
+		WatchInputBuffer(available);
+	}
 
-	// Implicitly cast LogsPtr type def to pointer "data"
-	LogsPtr data = (LogsPtr)callbackData;
+	// With catch-up reads, read every complete block that is waiting
+	int blocks = 1;
+	if (catchUpReads)
+	{
+		blocks = CatchUpBlocks(available);
+
+		// An earlier callback already read the block this event was raised for
+		if (blocks == 0)
+			return 0;
+	}
 
 	/*********************************************/
 	// DAQmx Read Code
 	/*********************************************/
-	DAQmxErrChk (DAQmxReadAnalogF64(DSATaskHandle,sampsPerChan,timeout,fillMode,dsaData,sampsPerChan,&dsaRead,NULL));
-	DAQmxErrChk (DAQmxReadAnalogF64(MIOTaskHandle,sampsPerChan,timeout,fillMode,mioData,sampsPerChan,&mioRead,NULL));
-
-	// Perform DFT
-	DFT(dsaData,mioData,sampleRate,sampsPerChan,data->dftData.precision,data->dftData.file,&measuredPhaseSkewDeg,&measuredPhaseSkewSec,&measuredFreq);
-
-	// Write to voltage data to CSV 
-	fprintf(data->voltageData.file,"Time (s),DSA Data (V),MIO Data (V)\n");
-	for (int i = 0; i < sampsPerChan; i++)
+	// Raw reads only transfer the codes. Scaling them is left to the analysis.
+	if (blocks > 1)
 	{
-		// Build time array
-		timeData[i] = i * (1/sampleRate);
-
-		// Print voltage data to CSV file
-		fprintf(data->voltageData.file,"%0.*f,%2.*f,%2.*f\n",data->voltageData.precision,timeData[i],data->voltageData.precision,dsaData[i],data->voltageData.precision,mioData[i]);
+		// Drain the backlog with one read per task into the batch buffers, then hand the blocks on in order
+		int32 batchSamples = blocks * sampsPerChan;
+		if (rawReads)
+		{
+			DAQmxErrChk (DAQmxReadBinaryI32(DSATaskHandle,batchSamples,timeout,fillMode,arena.batchCodes,batchSamples,&dsaRead,NULL));
+			DAQmxErrChk (DAQmxReadBinaryI32(MIOTaskHandle,batchSamples,timeout,fillMode,arena.batchCodes + maxCatchUpBlocks*sampsPerChan,batchSamples,&mioRead,NULL));
+		}
+		else
+		{
+			DAQmxErrChk (DAQmxReadAnalogF64(DSATaskHandle,batchSamples,timeout,fillMode,arena.batchData,batchSamples,&dsaRead,NULL));
+			DAQmxErrChk (DAQmxReadAnalogF64(MIOTaskHandle,batchSamples,timeout,fillMode,arena.batchData + maxCatchUpBlocks*sampsPerChan,batchSamples,&mioRead,NULL));
+		}
+		int32 read[MAX_TASKS] = {dsaRead, mioRead};
+		int complete = CompleteBatchBlocks(read,2);
+		for (int b = 0; b < complete; b++)
+		{
+			slot = BlockDestination(&dsaData,&mioData,&dsaCodes,&mioCodes);
+			if (rawReads)
+			{
+				memcpy(dsaCodes,arena.batchCodes + b*sampsPerChan,sizeof(int32) * sampsPerChan);
+				memcpy(mioCodes,arena.batchCodes + (maxCatchUpBlocks + b)*sampsPerChan,sizeof(int32) * sampsPerChan);
+			}
+			else
+			{
+				memcpy(dsaData,arena.batchData + b*sampsPerChan,sizeof(float64) * sampsPerChan);
+				memcpy(mioData,arena.batchData + (maxCatchUpBlocks + b)*sampsPerChan,sizeof(float64) * sampsPerChan);
+			}
+			DeliverBlock(callbackData,slot,dsaData,mioData,dsaCodes,mioCodes,sampsPerChan,sampsPerChan);
+		}
+	}
+	else
+	{
+		slot = BlockDestination(&dsaData,&mioData,&dsaCodes,&mioCodes);
+		if (rawReads)
+		{
+			DAQmxErrChk (DAQmxReadBinaryI32(DSATaskHandle,sampsPerChan,timeout,fillMode,dsaCodes,sampsPerChan,&dsaRead,NULL));
+			DAQmxErrChk (DAQmxReadBinaryI32(MIOTaskHandle,sampsPerChan,timeout,fillMode,mioCodes,sampsPerChan,&mioRead,NULL));
+		}
+		else
+		{
+			DAQmxErrChk (DAQmxReadAnalogF64(DSATaskHandle,sampsPerChan,timeout,fillMode,dsaData,sampsPerChan,&dsaRead,NULL));
+			DAQmxErrChk (DAQmxReadAnalogF64(MIOTaskHandle,sampsPerChan,timeout,fillMode,mioData,sampsPerChan,&mioRead,NULL));
+		}
+		DeliverBlock(callbackData,slot,dsaData,mioData,dsaCodes,mioCodes,dsaRead,mioRead);
 	}
-
-	// Calculate and print sample acquisition totals and DFT information
-	if( dsaRead>0 )
-		dsaTotalRead += dsaRead;
-	if( mioRead>0 )
-		mioTotalRead += mioRead;	
-	printf("%d\t\t\t%d\t\t\t%5.0f\t\t\t\t\t%2.2f\t\t\t%1.2e\r",(int)dsaTotalRead,(int)mioTotalRead,measuredFreq,measuredPhaseSkewDeg,measuredPhaseSkewSec);
-	fflush(stdout);
 
 Error:
 	if( DAQmxFailed(error) ) {
@@ -272,6 +442,100 @@ Error:
 	return 0;
 }
 
+// Analyses one block of samples and writes the results to the CSV files and the console. Blocks must be analysed in the order
+// they were read. dsaCodes and mioCodes are the raw codes the samples were scaled from, which are logged with them, or NULL.
+// dsaSpectrum and mioSpectrum are the spectra an analysis worker already calculated, or NULL.
+// dsaSkipped and mioSkipped count the samples of blocks dropped, and of partial catch-up reads, before this one, which are added to the totals.
+void AnalyzeBlock(void *callbackData, float64 *dsaData, float64 *mioData, int32 *dsaCodes, int32 *mioCodes, DFTComplex *dsaSpectrum, DFTComplex *mioSpectrum, int32 dsaRead, int32 mioRead, int32 dsaSkipped, int32 mioSkipped)
+{
+	double 			measuredPhaseSkewDeg=0,measuredPhaseSkewSec=0,measuredFreq=0;
+	static int32    dsaTotalRead=0,mioTotalRead=0;
+
+	// Implicitly cast LogsPtr type def to pointer "data"
+	LogsPtr data = (LogsPtr)callbackData;
+
+	dsaTotalRead += dsaSkipped;
+	mioTotalRead += mioSkipped;
+
+	// Print the input buffer warning the callback raised, off the callback thread
+	ReportInputBufferWarning();
+
+	// Write to voltage data to CSV before the DFT, which may write the spectra over the samples
+	fprintf(data->voltageData.file,dsaCodes != NULL ? "Time (s),DSA Data (V),MIO Data (V),DSA Code,MIO Code\n" : "Time (s),DSA Data (V),MIO Data (V)\n");
+	for (int i = 0; i < sampsPerChan; i++)
+	{
+		// Calculate the sample time
+		double timeData = i * (1/sampleRate);
+
+		// Print voltage data to CSV file, followed by the raw codes so the samples can be recovered exactly
+		fprintf(data->voltageData.file,"%0.*f,%2.*f,%2.*f",data->voltageData.precision,timeData,data->voltageData.precision,dsaData[i],data->voltageData.precision,mioData[i]);
+		if (dsaCodes != NULL)
+			fprintf(data->voltageData.file,",%d,%d",(int)dsaCodes[i],(int)mioCodes[i]);
+		fprintf(data->voltageData.file,"\n");
+	}
+
+	// Append the frames this block completes to the spectrogram, also before the DFT
+	if (spectrogram)
+	{
+		double *channels[2] = {dsaData, mioData};
+		SpectrogramBlock(channels,2,sampsPerChan);
+	}
+
+	// Perform DFT. Without a DFT plan the block is only counted.
+	if (!DFT(dsaData,mioData,dsaSpectrum,mioSpectrum,sampleRate,sampsPerChan,data->dftData.precision,data->dftData.file,&measuredPhaseSkewDeg,&measuredPhaseSkewSec,&measuredFreq))
+	{
+		dsaTotalRead += dsaRead;
+		mioTotalRead += mioRead;
+		return;
+	}
+
+	// Update the phase skew every slidingHopSize samples within the block
+	if (slidingDFT)
+	{
+		double *channels[2] = {dsaData, mioData};
+		SlidingDFTBlock(channels,1,2,sampsPerChan,(int)round(measuredFreq*sampsPerChan/sampleRate),sampleRate,data->slidingSkewData.file);
+	}
+
+	// Write the GCC-PHAT delay in whole and fractional samples to CSV
+	if (data->gccPhatData.file != NULL)
+	{
+		double delay = measuredPhaseSkewSec * sampleRate;
+		fprintf(data->gccPhatData.file,"%d,%d,%0.*f,%1.4e\n",(int)dsaTotalRead + dsaRead,(int)round(delay),data->gccPhatData.precision,delay-round(delay),measuredPhaseSkewSec);
+	}
+
+	// Write the distortion of both channels to CSV alongside the phase shift
+	if (data->harmonicData.file != NULL)
+	{
+		int precision = data->harmonicData.precision;
+		fprintf(data->harmonicData.file,"%d",(int)dsaTotalRead + dsaRead);
+		for (int c = 0; c < 2; c++)
+		{
+			HarmonicResult *result = &harmonicResults[c];
+			fprintf(data->harmonicData.file,",%0.*f,%0.*f,%0.*f,%0.*f,%0.*f",precision,result->fundamentalFreq,precision,result->thdDb,precision,result->sinadDb,precision,result->sfdrDb,precision,result->enob);
+		}
+		fprintf(data->harmonicData.file,",%1.4e\n",measuredPhaseSkewSec);
+	}
+
+	// Write every tone found in this block to CSV
+	if (data->multiToneData.file != NULL)
+	{
+		int precision = data->multiToneData.precision;
+		for (int t = 0; t < numDetectedTones; t++)
+		{
+			Tone *tone = &detectedTones[t];
+			fprintf(data->multiToneData.file,"%d,%d,%0.*f,%0.*f,%0.*f,%0.*f,%1.4e\n",(int)dsaTotalRead + dsaRead,t+1,precision,tone->freq,precision,tone->amplitude[0],precision,tone->amplitude[1],precision,tone->skewDeg[1],tone->skewSec[1]);
+		}
+	}
+
+	// Calculate and print sample acquisition totals and DFT information
+	if( dsaRead>0 )
+		dsaTotalRead += dsaRead;
+	if( mioRead>0 )
+		mioTotalRead += mioRead;	
+	printf("%d\t\t\t%d\t\t\t%5.0f\t\t\t\t\t%2.2f\t\t\t%1.2e\r",(int)dsaTotalRead,(int)mioTotalRead,measuredFreq,measuredPhaseSkewDeg,measuredPhaseSkewSec);
+	fflush(stdout);
+}
+
 int32 DoneCallback(TaskHandle taskHandle, int32 status, void *callbackData)
 {
 	int32   error=0;
@@ -285,6 +549,14 @@ int32 DoneCallback(TaskHandle taskHandle, int32 status, void *callbackData)
 	// Close CSV files
 	fclose(data->voltageData.file);
 	fclose(data->dftData.file);
+	if (data->slidingSkewData.file != NULL)
+		fclose(data->slidingSkewData.file);
+	if (data->gccPhatData.file != NULL)
+		fclose(data->gccPhatData.file);
+	if (data->harmonicData.file != NULL)
+		fclose(data->harmonicData.file);
+	if (data->multiToneData.file != NULL)
+		fclose(data->multiToneData.file);
 
 Error:
 	if( DAQmxFailed(error) ) {
@@ -300,8 +572,10 @@ Error:
 	return 0;
 }
 
-// Calculates a discrete Fourier transform using the FFTW libary
-void DFT(double *dsaData, double *mioData, double sampleRate, long long int sampsPerChan, int precision, FILE *file, double *measuredPhaseSkewDeg, double *measuredPhaseSkewSec, double *measuredFreq)
+// Calculates a discrete Fourier transform using the FFTW libary. The transform is skipped if an analysis worker
+// already calculated the spectra into dsaSpectrum and mioSpectrum. Returns 0, without measuring the block, if the
+// DFT plan cache had no plan for it.
+int DFT(double *dsaData, double *mioData, DFTComplex *dsaSpectrum, DFTComplex *mioSpectrum, double sampleRate, long long int sampsPerChan, int precision, FILE *file, double *measuredPhaseSkewDeg, double *measuredPhaseSkewSec, double *measuredFreq)
 {
 	
 	// Calculate in and out array sizes
@@ -311,68 +585,96 @@ void DFT(double *dsaData, double *mioData, double sampleRate, long long int samp
 	// Calculate maximum precision of frequency bins
 	double binPrecision = sampleRate/sampsPerChan;
 
-	// Instantiate variables for FFTW
-	double *dsaInput, *mioInput;
-	fftw_complex *dsaOutput, *mioOutput;
-	fftw_plan dsaDFT, mioDFT;
+	// Instantiate variables for FFTW. The input and output arrays are owned by the arena, unless the spectra were calculated by a worker.
+	DFTReal *dsaInput = arena.dsaInput, *mioInput = arena.mioInput;
+	DFTComplex *dsaOutput = dsaSpectrum != NULL ? dsaSpectrum : arena.dsaOutput, *mioOutput = mioSpectrum != NULL ? mioSpectrum : arena.mioOutput;
+	DFTPlan plan;
 
-	// Allocated input and output arrays
-	dsaInput = (double*)fftw_malloc(sizeof(double) * n);
-	mioInput = (double*)fftw_malloc(sizeof(double) * n);
-	dsaOutput = (fftw_complex*)fftw_malloc(sizeof(fftw_complex) * nc);
-	mioOutput = (fftw_complex*)fftw_malloc(sizeof(fftw_complex) * nc);
+	// The evaluated bins are stored from output[0]. Without tone tracking this is the full spectrum.
+	int firstBin = 0;
+	int numBins = nc;
 
-	// Store real data in the input arrays
-	StoreData(n,dsaData,dsaInput);
-	StoreData(n,mioData,mioInput);
-
-	// Instantiate plan for a 1D DFT of the real data
-	dsaDFT = fftw_plan_dft_r2c_1d(n,dsaInput,dsaOutput,FFTW_ESTIMATE);
-	mioDFT = fftw_plan_dft_r2c_1d(n,mioInput,mioOutput,FFTW_ESTIMATE);
+	// While a stable tone is tracked, evaluate only the tracked bin and its neighbours
+	if (dsaSpectrum == NULL && toneTracking && toneTracker.locked && !gccPhatEstimator && !harmonicAnalysis && !multiToneDetection)
+	{
+		firstBin = toneTracker.bin - trackingNeighbourBins > 0 ? toneTracker.bin - trackingNeighbourBins : 0;
+		numBins = (toneTracker.bin + trackingNeighbourBins < nc ? toneTracker.bin + trackingNeighbourBins : nc - 1) - firstBin + 1;
+		GoertzelBins(dsaData,dftWindow,1,n,firstBin,numBins,dsaOutput);
+		GoertzelBins(mioData,dftWindow,1,n,firstBin,numBins,mioOutput);
+
+		// Fall back to the full DFT of this block if the tone has moved
+		DFTComplex *trackedSpectra[2] = {dsaOutput, mioOutput};
+		if (!ToneStillTracked(trackedSpectra,2,firstBin,numBins))
+		{
+			firstBin = 0;
+			numBins = nc;
+		}
+	}
 
-	// Execute the DFTs
-	fftw_execute(dsaDFT);
-	fftw_execute(mioDFT);
+	if (numBins == nc && dsaSpectrum == NULL)
+	{
+		// Look up the 1D DFT plan created at startup. Every arena buffer has
+		// the same alignment, so both channels share the same cached plan.
+		plan = GetDFTPlan(n,1,0,dsaInput,dsaOutput);
+		if (plan == NULL)
+			return 0;
+
+		// Store real data in the input arrays, unless DAQmx read straight into them, and execute the DFTs on this callback's
+		// buffers. The MIO channel is handed to the worker thread first so both channels are transformed at the same time.
+		if (concurrentChannelDFTs)
+			StartChannelDFT(plan,n,mioData,mioInput,mioOutput);
+		else
+		{
+			if (!arena.directInput)
+				StoreData(n,1,mioData,dftWindow,mioInput);
+			ExecuteDFT(plan,mioInput,mioOutput);
+		}
+		if (!arena.directInput)
+			StoreData(n,1,dsaData,dftWindow,dsaInput);
+		ExecuteDFT(plan,dsaInput,dsaOutput);
+		if (concurrentChannelDFTs)
+			WaitForChannelDFT();
+	}
 	
-	// Open CSV file
-	fprintf(file,"Frequency (Hz),DSA Magnitude,DSA Amplitude (V),MIO Magnitude,MIO Amplitude (V)\n");
-
-	// Insantiate variables to track the frequency in a measured signal
-	int maxMagnitudeIndex = 0;
-	int maxMagnitude = 0;
-
-	// Calculate and store the frequency components
-	for (int i = 0; i < nc; i++)
-	{	
-		// Allocate the real and imaginary DFT components of each frequency to variables
-		double dsaRealComp = dsaOutput[i][REAL];
-		double dsaImagComp = dsaOutput[i][IMAG];
-		double mioRealComp = mioOutput[i][REAL];
-		double mioImagComp = mioOutput[i][IMAG];
-		
-		// Calculate the frequency, magnitude, and amplitude from the DFT data
-		double freq = i * binPrecision;
-		double dsaMagnitude = sqrt((dsaRealComp*dsaRealComp) + (dsaImagComp*dsaImagComp));
-		double mioMagnitude = sqrt((mioRealComp*mioRealComp) + (mioImagComp*mioImagComp));
-		double dsaAmplitude = dsaMagnitude * 2 / n;
-		double mioAmplitude = mioMagnitude * 2 / n;
-
-		// Write DFT data to CSV file
-		fprintf(file,"%5.2f,%5.*f,%5.*f,%5.*f,%5.*f\n",freq,precision,dsaMagnitude,precision,dsaAmplitude,precision,mioMagnitude,precision,mioAmplitude);
-
-		// Find at which frequency bin the highest magnitude exists
-		if ( dsaMagnitude >= maxMagnitude && mioMagnitude >= maxMagnitude)
+	// Calculate the magnitude and amplitude of every bin of both channels and find the bin at which both are strongest
+	DFTComplex *spectra[2] = {dsaOutput, mioOutput};
+	DFTReal *magnitudes[2] = {arena.magnitudes, arena.magnitudes + nc};
+	DFTReal *amplitudes[2] = {arena.amplitudes, arena.amplitudes + nc};
+	int maxMagnitudeIndex = firstBin + SpectrumKernel(spectra,2,numBins,2 / (n * dftWindowCoherentGain),logSpectrum ? magnitudes : NULL,amplitudes);
+
+	// Measure the distortion of both channels from the same spectra
+	if (harmonicAnalysis)
+	{
+		double fullScaleVolts[2] = {(maxValDSA - minValDSA) / 2, (maxValMIO - minValMIO) / 2};
+		for (int c = 0; c < 2; c++)
+			AnalyzeHarmonics(spectra[c],n,maxMagnitudeIndex,binPrecision,fullScaleVolts[c],&harmonicResults[c]);
+	}
+
+	// Find every tone and its phase shift in the same spectra
+	if (multiToneDetection)
+		DetectTones(spectra,2,n,binPrecision);
+
+	// Write DFT data to CSV file. Tone amplitudes are corrected by the coherent gain of the window and noise densities by its noise power gain.
+	if (logSpectrum)
+	{
+		double densityScale = sqrt(2 / (sampleRate * n * dftWindowNoiseGain));
+		fprintf(file,"Frequency (Hz),DSA Magnitude,DSA Amplitude (V),DSA Noise Density (V/rtHz),MIO Magnitude,MIO Amplitude (V),MIO Noise Density (V/rtHz)\n");
+		for (int i = 0; i < numBins; i++)
 		{
-			maxMagnitude = dsaMagnitude;
-			maxMagnitudeIndex = i;
+			double freq = (firstBin + i) * binPrecision;
+			fprintf(file,"%5.2f,%5.*f,%5.*f,%1.4e,%5.*f,%5.*f,%1.4e\n",freq,precision,magnitudes[0][i],precision,amplitudes[0][i],magnitudes[0][i]*densityScale,precision,magnitudes[1][i],precision,amplitudes[1][i],magnitudes[1][i]*densityScale);
 		}
 	}
 
 	// Assign variables for real and imaginary components at the maximum frequency
-	double dsaMaxRealComp = dsaOutput[maxMagnitudeIndex][REAL];
-	double dsaMaxImagComp = dsaOutput[maxMagnitudeIndex][IMAG];
-	double mioMaxRealComp = mioOutput[maxMagnitudeIndex][REAL];
-	double mioMaxImagComp = mioOutput[maxMagnitudeIndex][IMAG];
+	double dsaMaxRealComp = dsaOutput[maxMagnitudeIndex-firstBin][REAL];
+	double dsaMaxImagComp = dsaOutput[maxMagnitudeIndex-firstBin][IMAG];
+	double mioMaxRealComp = mioOutput[maxMagnitudeIndex-firstBin][REAL];
+	double mioMaxImagComp = mioOutput[maxMagnitudeIndex-firstBin][IMAG];
+
+	// Start tracking the tone once it has stayed in the same bin
+	if (toneTracking)
+		UpdateToneTracker(maxMagnitudeIndex,sqrt((dsaMaxRealComp*dsaMaxRealComp) + (dsaMaxImagComp*dsaMaxImagComp)));
 
 	// Calculate frequency of measured signal
 	double maxFreq = maxMagnitudeIndex * binPrecision;
@@ -381,42 +683,188 @@ void DFT(double *dsaData, double *mioData, double sampleRate, long long int samp
 	double dsaPhase = atan2(dsaMaxImagComp,dsaMaxRealComp) * (180/PI);
 	double mioPhase = atan2(mioMaxImagComp,mioMaxRealComp) * (180/PI);
 
+	// Interpolate the tone frequency between bins and correct both phases for the offset from the bin centre
+	if (interpolatedEstimator && maxMagnitudeIndex > firstBin && maxMagnitudeIndex < firstBin + numBins - 1)
+	{
+		int peak = maxMagnitudeIndex - firstBin;
+		double delta = InterpolateHannPeak(BinMagnitude(dsaOutput[peak-1]) + BinMagnitude(mioOutput[peak-1]),
+			BinMagnitude(dsaOutput[peak]) + BinMagnitude(mioOutput[peak]),
+			BinMagnitude(dsaOutput[peak+1]) + BinMagnitude(mioOutput[peak+1]));
+		maxFreq = (maxMagnitudeIndex + delta) * binPrecision;
+		dsaPhase -= 180 * delta;
+		mioPhase -= 180 * delta;
+	}
+
+	// Zoom in on the band around the peak bin and take the frequency and phases where the tone is strongest
+	if (zoomFFT)
+	{
+		double *channels[2] = {dsaData, mioData};
+		double zoomPhase[2];
+		if (ZoomTone(channels,2,maxMagnitudeIndex,binPrecision,&maxFreq,zoomPhase))
+		{
+			dsaPhase = zoomPhase[0];
+			mioPhase = zoomPhase[1];
+		}
+	}
+
 	// Calculate phase skew between DSA and MIO device
 	double phaseSkewDeg = NormalizePhaseAngleDifference(dsaPhase-mioPhase); // phase skew in degrees
 	double phaseSkewSec = ((dsaPhase-mioPhase)/360) * (1/maxFreq); // phase skew in seconds
 
+	// Compare against the phase skew calculated in float64 from the samples as read
+	if (DFT_SINGLE_PRECISION && comparePrecision && PrecisionCheckDue())
+		ComparePhaseSkewPrecision(dsaData,mioData,1,n,maxMagnitudeIndex,phaseSkewDeg);
+
+	// Add this block to the averaged spectra
+	if (welchAveraging || groupDelayEstimator)
+	{
+		DFTComplex *outputs[2] = {dsaOutput, mioOutput};
+		WelchAccumulate(outputs,firstBin,numBins);
+	}
+
+	// Report the phase skew of the averaged cross-spectrum instead
+	if (welchAveraging)
+	{
+		phaseSkewDeg = WelchPhaseSkewDeg(1,maxMagnitudeIndex);
+		phaseSkewSec = (phaseSkewDeg/360) * (1/maxFreq);
+	}
+
+	// Measure the delay from the PHAT weighted cross-correlation
+	if (gccPhatEstimator)
+	{
+		DFTComplex *outputs[2] = {dsaOutput, mioOutput};
+		double delays[2];
+		if (GccPhatDelays(outputs,2,n,delays))
+		{
+			phaseSkewSec = delays[1] / sampleRate;
+			phaseSkewDeg = NormalizePhaseAngleDifference(phaseSkewSec * 360 * maxFreq);
+		}
+	}
+
+	// Report the skew fitted over every coherent bin if any bins passed the thresholds
+	double skewSec;
+	if (groupDelayEstimator && GroupDelaySkewSec(1,binPrecision,&skewSec) > 0)
+	{
+		phaseSkewSec = skewSec;
+		phaseSkewDeg = NormalizePhaseAngleDifference(skewSec * 360 * maxFreq);
+	}
+
 	// Assign values to be displayed on the console
 	*measuredPhaseSkewDeg = phaseSkewDeg;
 	*measuredPhaseSkewSec = phaseSkewSec;
 	*measuredFreq = maxFreq;
+	return 1;
+}
 
-	// Free the resources
-	fftw_destroy_plan(dsaDFT);
-	fftw_destroy_plan(mioDFT);
-	fftw_free(dsaInput); 
-	fftw_free(dsaOutput);
-	fftw_free(mioInput); 
-	fftw_free(mioOutput);
+// Carves every buffer used on the acquisition path out of the arena. Without an allocated block it only adds up their sizes.
+void CarveAcquisitionArena(int length, int channels)
+{
+	int nc = (length/2)+1;
+
+	// Samples are read straight into the DFT input unless they have to be converted to float32 or windowed first, or are read into the analysis ring.
+	// The spectra are then written over the samples unless the sliding DFT, the tone tracker or the zoom FFT still need them.
+	arena.directInput = !DFT_SINGLE_PRECISION && dftWindow == NULL && !analysisThread;
+	arena.inPlace = arena.directInput && !slidingDFT && !toneTracking && !zoomFFT;
+
+	// The sample buffers are padded to 2*(length/2+1) values so an in-place DFT fits
+	arena.dsaData = (float64*)ArenaAlloc(sizeof(float64) * 2 * nc);
+	arena.mioData = (float64*)ArenaAlloc(sizeof(float64) * 2 * nc);
+	if (rawReads)
+	{
+		arena.dsaCodes = (int32*)ArenaAlloc(sizeof(int32) * length);
+		arena.mioCodes = (int32*)ArenaAlloc(sizeof(int32) * length);
+	}
+	arena.dsaInput = arena.directInput ? (DFTReal*)arena.dsaData : (DFTReal*)ArenaAlloc(sizeof(DFTReal) * length);
+	arena.mioInput = arena.directInput ? (DFTReal*)arena.mioData : (DFTReal*)ArenaAlloc(sizeof(DFTReal) * length);
+	arena.dsaOutput = arena.inPlace ? (DFTComplex*)arena.dsaData : (DFTComplex*)ArenaAlloc(sizeof(DFTComplex) * nc);
+	arena.mioOutput = arena.inPlace ? (DFTComplex*)arena.mioData : (DFTComplex*)ArenaAlloc(sizeof(DFTComplex) * nc);
+	arena.magnitudes = (DFTReal*)ArenaAlloc(sizeof(DFTReal) * 2 * nc);
+	arena.amplitudes = (DFTReal*)ArenaAlloc(sizeof(DFTReal) * 2 * nc);
+	if (catchUpReads && rawReads)
+		arena.batchCodes = (int32*)ArenaAlloc(sizeof(int32) * length * 2 * maxCatchUpBlocks);
+	else if (catchUpReads)
+		arena.batchData = (float64*)ArenaAlloc(sizeof(float64) * length * 2 * maxCatchUpBlocks);
+
+	// The analysis buffers and the analysis ring, with each channel of a slot starting on a cache line
+	CarveAnalysisBuffers(length,channels);
+	CarveAnalysisRing(length,channels,1);
 }
 
-// Stores voltage data in arrays of real data to be used in the DFT
-void StoreData(int arraySize, double *dataToAllocate, double *output)
+// Calculates the spectra of both channels of a block into its slot. Runs on an analysis worker, so it only writes the slot's buffers.
+void TransformBlock(AnalysisRingSlot *slot)
 {
-	// Store data in new array
-	for (int i = 0; i < arraySize; i++)
+	int n = sampsPerChan;
+	float64 *dsaData = slot->data, *mioData = slot->data + analysisRing.dataStride;
+
+	// The codes are scaled here, ahead of the analysis thread
+	if (rawReads)
+		ScaleRawBlock(slot->codes,slot->codes + analysisRing.dataStride,dsaData,mioData);
+
+	// The DFT reads the samples directly unless they have to be converted to float32 or windowed first
+	DFTReal *dsaInput = (DFTReal*)dsaData, *mioInput = (DFTReal*)mioData;
+	if (slot->input != NULL)
 	{
-		output[i] = dataToAllocate[i];
+		dsaInput = slot->input;
+		mioInput = slot->input + analysisRing.inputStride;
+		StoreData(n,1,dsaData,dftWindow,dsaInput);
+		StoreData(n,1,mioData,dftWindow,mioInput);
 	}
+
+	// Every slot buffer has the same alignment as the arena buffers, so the plan created at startup is used.
+	// Without a plan the block is left to the analysis thread, which skips it the same way.
+	DFTPlan plan = GetDFTPlan(n,1,0,dsaInput,slot->output);
+	slot->hasSpectra = plan != NULL;
+	if (plan == NULL)
+		return;
+	ExecuteDFT(plan,dsaInput,slot->output);
+	ExecuteDFT(plan,mioInput,slot->output + analysisRing.outputStride);
 }
 
-// Ensures the phase angle is between -180 deg and 180 deg
-double NormalizePhaseAngleDifference(double phase)
+// Analyses the block in a ring slot on the analysis thread. The codes are scaled here unless an analysis worker already scaled them.
+void AnalyzeRingSlot(void *callbackData, AnalysisRingSlot *slot)
 {
-	if (phase > 270)
-		phase = phase - 360;
-	
-	if (phase < -90)
-		phase = phase + 360;
+	int workers = AnalysisWorkerCount();
+	float64 *mioData = slot->data + analysisRing.dataStride;
+	int32 *mioCodes = rawReads ? slot->codes + analysisRing.dataStride : NULL;
+	if (rawReads && workers == 0)
+		ScaleRawBlock(slot->codes,mioCodes,slot->data,mioData);
+	AnalyzeBlock(callbackData,slot->data,mioData,slot->codes,mioCodes,workers > 0 && slot->hasSpectra ? slot->output : NULL,workers > 0 && slot->hasSpectra ? slot->output + analysisRing.outputStride : NULL,slot->read[0],slot->read[1],slot->skipped[0],slot->skipped[1]);
+}
+
+// Points the buffers at the ring slot the next block is read into and returns the slot. Without the analysis thread, or if every
+// slot is still waiting, they are pointed at the arena instead and NULL is returned. The block is then dropped by the ring.
+AnalysisRingSlot *BlockDestination(float64 **dsaData, float64 **mioData, int32 **dsaCodes, int32 **mioCodes)
+{
+	AnalysisRingSlot *slot = analysisThread ? NextFreeRingSlot() : NULL;
+	*dsaData = slot != NULL ? slot->data : arena.dsaData;
+	*mioData = slot != NULL ? slot->data + analysisRing.dataStride : arena.mioData;
+	*dsaCodes = slot != NULL ? slot->codes : arena.dsaCodes;
+	*mioCodes = slot != NULL && rawReads ? slot->codes + analysisRing.dataStride : arena.mioCodes;
+	return slot;
+}
 
-	return phase;
-}
\ No newline at end of file
+// Hands a block that has been read to the analysis thread, or analyses it on this thread if there is none
+void DeliverBlock(void *callbackData, AnalysisRingSlot *slot, float64 *dsaData, float64 *mioData, int32 *dsaCodes, int32 *mioCodes, int32 dsaRead, int32 mioRead)
+{
+	if (analysisThread)
+	{
+		int32 read[MAX_TASKS] = {dsaRead, mioRead};
+		PublishRingSlot(slot,read);
+	}
+	else
+	{
+		// Without the analysis thread the codes are scaled on this thread
+		if (rawReads)
+			ScaleRawBlock(dsaCodes,mioCodes,dsaData,mioData);
+		int32 skipped[MAX_TASKS];
+		TakeSkippedSamples(skipped);
+		AnalyzeBlock(callbackData,dsaData,mioData,rawReads ? dsaCodes : NULL,rawReads ? mioCodes : NULL,NULL,NULL,dsaRead,mioRead,skipped[0],skipped[1]);
+	}
+}
+
+// Scales the raw codes of both channels of a block to volts
+void ScaleRawBlock(int32 *dsaCodes, int32 *mioCodes, float64 *dsaData, float64 *mioData)
+{
+	ScaleRawCodes(dsaCodes,&rawScaling[0],sampsPerChan,dsaData);
+	ScaleRawCodes(mioCodes,&rawScaling[1],sampsPerChan,mioData);
+}
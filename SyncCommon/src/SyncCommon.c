@@ -0,0 +1,2554 @@
+/*********************************************************************
+*
+* SyncCommon.c
+*
+* Description:
+*    Analysis, DFT plan cache and backend, acquisition arena and
+*    analysis ring code shared by SmplClkSync, RefClkSync and
+*    ChnlExpSync. See SyncCommon.h.
+*
+*********************************************************************/
+
+#define _GNU_SOURCE // For pthread_setaffinity_np()
+#include "SyncCommon.h"
+
+static __thread int dftWorkSlot; // Work buffers of the built-in FFT used by the calling thread. Set to 1 on the channel DFT worker thread and to 2+w on analysis worker w.
+
+AnalysisRing analysisRing;
+CatchUpStats catchUp;
+InputBufferState inputBuffer;
+DFTPlanCache dftPlanCache;
+PrecisionReport precisionReport;
+ToneTracker toneTracker;
+ArenaAllocator arenaAllocator;
+Tone detectedTones[MAX_TONES];
+int numDetectedTones = 0;
+ToneDetector toneDetector;
+GccPhatState gccPhatState;
+DFTReal *dftWindow = NULL;
+double dftWindowCoherentGain = 1;
+double dftWindowNoiseGain = 1;
+SlidingDFTState slidingDFTState;
+ZoomFFTState zoomFFTState;
+SpectrogramState spectrogramState;
+WelchAverager welchAverager;
+ChannelDFTWorker channelDFTWorker;
+
+
+// Stores GroupByChannel voltage data in arrays of real data to be used in the DFT, converting it to DFTReal
+// and applying the window (if not NULL) in the same pass
+void StoreData(int length, int numChannels, double *dataToAllocate, DFTReal *window, DFTReal *output)
+{
+	// Store data in new array
+	for (int c = 0; c < numChannels; c++)
+	{
+		for (int i = 0; i < length; i++)
+			output[c*length+i] = window != NULL ? dataToAllocate[c*length+i] * window[i] : dataToAllocate[c*length+i];
+	}
+}
+
+// Allocates the acquisition arena and carves its buffers with carve(), which calls ArenaAlloc() for every buffer
+// of the program. Must be called after InitDFTWindow().
+void InitAcquisitionArena(CarveArenaFunction carve, int length, int channels)
+{
+	// The first pass only measures the buffers, the second carves them out of the allocated block
+	carve(length,channels);
+	arenaAllocator.size = arenaAllocator.used;
+	arenaAllocator.block = (char*)FFTW(malloc)(arenaAllocator.size + ARENA_ALIGNMENT);
+	arenaAllocator.base = arenaAllocator.block + (ARENA_ALIGNMENT - (uintptr_t)arenaAllocator.block % ARENA_ALIGNMENT) % ARENA_ALIGNMENT;
+	arenaAllocator.used = 0;
+
+	// Zeroing the block also faults its pages in now rather than on the first callback. The averages and histories
+	// carved from it rely on starting at 0.
+	memset(arenaAllocator.block,0,arenaAllocator.size + ARENA_ALIGNMENT);
+	carve(length,channels);
+}
+
+// Returns the next buffer of the arena, rounded up to ARENA_ALIGNMENT bytes. Only carve functions may call it:
+// during the sizing pass it returns NULL and only counts the bytes.
+void *ArenaAlloc(size_t bytes)
+{
+	size_t alignedBytes = (bytes + ARENA_ALIGNMENT - 1) / ARENA_ALIGNMENT * ARENA_ALIGNMENT;
+	void *buffer = arenaAllocator.base != NULL ? arenaAllocator.base + arenaAllocator.used : NULL;
+	arenaAllocator.used += alignedBytes;
+	return buffer;
+}
+
+// Carves the buffers of the shared analysis: the sliding DFT history, the averaged spectra, the zoom FFT, spectrogram,
+// multi-tone detection and GCC-PHAT buffers, and the built-in FFTs. Called by each program's carve function.
+// Without an allocated block it only adds up their sizes.
+void CarveAnalysisBuffers(int length, int channels)
+{
+	int nc = (length/2)+1;
+	if (slidingDFT)
+	{
+		// The history starts out zeroed, and no bin is tracked yet, so the first block recalculates the sliding DFT
+		slidingDFTState.history = (double*)ArenaAlloc(sizeof(double) * length * channels);
+		slidingDFTState.bin = -1;
+	}
+	if (welchAveraging || groupDelayEstimator)
+	{
+		welchAverager.numBins = nc;
+		welchAverager.numChannels = channels;
+		welchAverager.crossSpectrum = (double(*)[2])ArenaAlloc(sizeof(double[2]) * nc * channels);
+		welchAverager.autoSpectrum = (double*)ArenaAlloc(sizeof(double) * nc * channels);
+		if (groupDelayEstimator)
+		{
+			welchAverager.fitWeight = (double*)ArenaAlloc(sizeof(double) * nc);
+			welchAverager.fitBins = (int*)ArenaAlloc(sizeof(int) * nc);
+		}
+		if (welchAveraging == 2)
+		{
+			welchAverager.crossHistory = (double(*)[2])ArenaAlloc(sizeof(double[2]) * welchBlocks * nc * channels);
+			welchAverager.autoHistory = (double*)ArenaAlloc(sizeof(double) * welchBlocks * nc * channels);
+		}
+	}
+	if (zoomFFT)
+	{
+		SizeZoomFFT(length);
+		if (zoomFFTState.fftLength > 0)
+		{
+			zoomFFTState.twiddleRe = (DFTReal*)ArenaAlloc(sizeof(DFTReal) * length);
+			zoomFFTState.twiddleIm = (DFTReal*)ArenaAlloc(sizeof(DFTReal) * length);
+			zoomFFTState.weight = (DFTReal*)ArenaAlloc(sizeof(DFTReal) * length);
+			zoomFFTState.segmentStart = (int*)ArenaAlloc(sizeof(int) * zoomFFTState.decimatedLength);
+			for (int i = 0; i < 2; i++)
+			{
+				zoomFFTState.input[i] = (DFTReal*)ArenaAlloc(sizeof(DFTReal) * zoomFFTState.fftLength);
+				zoomFFTState.spectrum[i] = (DFTComplex*)ArenaAlloc(sizeof(DFTComplex) * ((zoomFFTState.fftLength/2)+1));
+			}
+			zoomFFTState.band = (DFTComplex*)ArenaAlloc(sizeof(DFTComplex) * zoomPoints * channels);
+			zoomFFTState.gain = (double*)ArenaAlloc(sizeof(double) * zoomPoints);
+		}
+	}
+	if (spectrogram)
+	{
+		spectrogramState.history = (double*)ArenaAlloc(sizeof(double) * (stftLength + length) * channels);
+		spectrogramState.window = (DFTReal*)ArenaAlloc(sizeof(DFTReal) * stftLength);
+		spectrogramState.frame = (DFTReal*)ArenaAlloc(sizeof(DFTReal) * stftLength);
+		spectrogramState.spectrum = (DFTComplex*)ArenaAlloc(sizeof(DFTComplex) * ((stftLength/2)+1));
+		spectrogramState.row = ArenaAlloc(sizeof(float) * ((stftLength/2)+1) * channels);
+		spectrogramState.fileBuffer = (char*)ArenaAlloc(spectrogramBufferBytes);
+	}
+	if (multiToneDetection)
+	{
+		toneDetector.power = (double*)ArenaAlloc(sizeof(double) * nc);
+		toneDetector.scratch = (double*)ArenaAlloc(sizeof(double) * nc);
+	}
+	if (gccPhatEstimator && channels > 1)
+	{
+		gccPhatState.pairs = channels - 1;
+		gccPhatState.cross = (DFTComplex*)ArenaAlloc(sizeof(DFTComplex) * nc * gccPhatState.pairs);
+		gccPhatState.correlation = (DFTReal*)ArenaAlloc(sizeof(DFTReal) * length * gccPhatState.pairs);
+	}
+
+	// A built-in FFT for every length InitDFTPlanCache() plans, unless FFTW executes every plan. The GCC-PHAT
+	// inverse has the length of the block, so it shares the block's FFT.
+	dftPlanCache.builtinFFTCount = 0;
+	if (dftBackend != DFT_BACKEND_FFTW)
+	{
+		CarveBuiltinFFT(length);
+		if (spectrogram)
+			CarveBuiltinFFT(stftLength);
+		if (zoomFFT && zoomFFTState.fftLength > 0)
+			CarveBuiltinFFT(zoomFFTState.fftLength);
+	}
+}
+
+// Frees the acquisition arena
+void DestroyAcquisitionArena(void)
+{
+	FFTW(free)(arenaAllocator.block);
+	arenaAllocator.block = NULL;
+	arenaAllocator.base = NULL;
+}
+
+// Creates the DFT plans used during acquisition so that no planning happens on the callback thread. The block DFT
+// transforms "channels" channels at once on buffers laid out like real and complex. Returns -1, and the program must
+// not start acquiring, if the cache could not hold every plan.
+int InitDFTPlanCache(int length, int channels, DFTReal *real, DFTComplex *complex)
+{
+	struct timespec start, end;
+	int useWisdom = (fftwWisdomFileName != NULL && dftPlannerFlag != FFTW_ESTIMATE);
+	clock_gettime(CLOCK_MONOTONIC,&start);
+
+	// Import the wisdom saved by a previous run so matching plans are not measured again
+	if (useWisdom)
+		dftPlanCache.wisdomImported = FFTW(import_wisdom_from_filename)(fftwWisdomFileName);
+
+	// Plan against the arena buffers the program's DFT() uses. Every arena buffer has the same alignment.
+	GetDFTPlan(length,channels,0,real,complex);
+
+	// The spectrogram transforms one frame of one channel at a time
+	if (spectrogram)
+		GetDFTPlan(stftLength,1,0,spectrogramState.frame,spectrogramState.spectrum);
+
+	// The GCC-PHAT estimator transforms the cross-spectra of every channel but the first back in one batch
+	if (gccPhatEstimator && gccPhatState.pairs > 0)
+		GetDFTPlan(length,gccPhatState.pairs,1,gccPhatState.correlation,gccPhatState.cross);
+
+	// The zoom FFT transforms the real and imaginary parts of the decimated samples of one channel at a time
+	if (zoomFFT && zoomFFTState.fftLength > 0)
+		GetDFTPlan(zoomFFTState.fftLength,1,0,zoomFFTState.input[0],zoomFFTState.spectrum[0]);
+
+	// Start FFTW's threads on the DFT cores, so the DAQmx callback can execute the DFTs without being restricted itself
+	RestrictDFTThreadPool(GetDFTPlan(length,channels,0,real,complex),real,complex);
+	if (dftPlanCache.plansRefused > 0)
+		return -1;
+
+	// Save the wisdom if any plan had to be measured
+	if (useWisdom && dftPlanCache.plansMeasured > 0 && !FFTW(export_wisdom_to_filename)(fftwWisdomFileName))
+		printf("Unable to save FFTW wisdom to %s\n",fftwWisdomFileName);
+
+	clock_gettime(CLOCK_MONOTONIC,&end);
+	dftPlanCache.planningTimeSec = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+	// Any plan created from here on is counted as created during acquisition
+	dftPlanCache.acquiring = 1;
+	return 0;
+}
+
+// Returns the cached plan for real-to-complex (or, if inverse is set, complex-to-real) DFTs of "channels" channels
+// of the given length on buffers laid out like "real" and "complex". Channel c of the real data starts at
+// real[c*length] and its spectrum at complex[c*(length/2+1)]. A new plan is only created on a cache miss.
+DFTPlan GetDFTPlan(int length, int channels, int inverse, DFTReal *real, DFTComplex *complex)
+{
+	DFTReal *in = inverse ? (DFTReal*)complex : real;
+	DFTReal *out = inverse ? real : (DFTReal*)complex;
+	int inPlace = ((void*)in == (void*)out);
+	int inAlignment = FFTW(alignment_of)(in);
+	int outAlignment = FFTW(alignment_of)(out);
+
+	// Search the cache for a matching plan
+	for (int i = 0; i < dftPlanCache.count; i++)
+	{
+		DFTPlanCacheEntry *entry = &dftPlanCache.entries[i];
+		if (entry->length == length && entry->channels == channels && entry->precision == sizeof(DFTReal) && entry->inverse == inverse && entry->inPlace == inPlace
+			&& entry->inAlignment == inAlignment && entry->outAlignment == outAlignment)
+			return entry;
+	}
+	if (dftPlanCache.count == DFT_PLAN_CACHE_SIZE)
+	{
+		if (dftPlanCache.plansRefused++ == 0)
+			printf("\nThe DFT plan cache is full (%d plans), so the work that needs another plan is skipped\n",DFT_PLAN_CACHE_SIZE);
+		return NULL;
+	}
+
+	// Plan on scratch buffers with the same alignment so the caller's data is never touched by the planner
+	int nc = (length/2)+1;
+	char *scratchIn = (char*)FFTW(malloc)(sizeof(DFTComplex) * nc * channels + inAlignment);
+	char *scratchOut = inPlace ? scratchIn : (char*)FFTW(malloc)(sizeof(DFTComplex) * nc * channels + outAlignment);
+	char *planIn = scratchIn + inAlignment;
+	char *planOut = inPlace ? planIn : scratchOut + outAlignment;
+	DFTReal *planReal = (DFTReal*)(inverse ? planOut : planIn);
+	DFTComplex *planComplex = (DFTComplex*)(inverse ? planIn : planOut);
+
+	DFTPlanCacheEntry *entry = &dftPlanCache.entries[dftPlanCache.count];
+	entry->length = length;
+	entry->channels = channels;
+	entry->precision = sizeof(DFTReal);
+	entry->inverse = inverse;
+	entry->inPlace = inPlace;
+	entry->inAlignment = inAlignment;
+	entry->outAlignment = outAlignment;
+	entry->fftwPlan = NULL;
+	entry->builtinFFT = NULL;
+	entry->fftwMs = 0;
+	entry->builtinMs = 0;
+	entry->backend = dftBackend == DFT_BACKEND_BUILTIN ? DFT_BACKEND_BUILTIN : DFT_BACKEND_FFTW;
+
+	// The built-in FFTs are carved from the arena for the lengths planned at startup. A plan of another length uses FFTW.
+	if (dftBackend == DFT_BACKEND_BUILTIN || (dftBackend == DFT_BACKEND_AUTO && !dftPlanCache.acquiring))
+		entry->builtinFFT = CreateBuiltinFFT(length);
+	if (entry->builtinFFT == NULL)
+		entry->backend = DFT_BACKEND_FFTW;
+
+	if (entry->backend == DFT_BACKEND_FFTW)
+	{
+		// Never measure on the callback thread
+		if (!dftPlanCache.acquiring && dftPlannerFlag != FFTW_ESTIMATE)
+		{
+			// Warm start: reuse a plan from the wisdom file without measuring
+			if (dftPlanCache.wisdomImported)
+				entry->fftwPlan = CreateDFTPlan(length,channels,inverse,planReal,planComplex,dftPlannerFlag|FFTW_WISDOM_ONLY);
+			if (entry->fftwPlan != NULL)
+				dftPlanCache.plansFromWisdom++;
+			else if (measureOnWisdomMiss)
+			{
+				entry->fftwPlan = CreateDFTPlan(length,channels,inverse,planReal,planComplex,dftPlannerFlag);
+				dftPlanCache.plansMeasured++;
+			}
+		}
+		if (entry->fftwPlan == NULL)
+			entry->fftwPlan = CreateDFTPlan(length,channels,inverse,planReal,planComplex,FFTW_ESTIMATE);
+	}
+
+	// Time both backends and keep the faster one, but never on the callback thread. A plan missed during acquisition uses FFTW.
+	if (dftBackend == DFT_BACKEND_AUTO && entry->builtinFFT != NULL)
+		SelectDFTBackend(entry,planReal,planComplex);
+	dftPlanCache.count++;
+
+	// Track when the plan was created
+	if (dftPlanCache.acquiring)
+		dftPlanCache.plansCreatedDuringAcquisition++;
+	else
+		dftPlanCache.plansCreatedAtStartup++;
+
+	if (!inPlace)
+		FFTW(free)(scratchOut);
+	FFTW(free)(scratchIn);
+	return entry;
+}
+
+// Creates a plan for real-to-complex, or complex-to-real if inverse is set, DFTs of "channels" contiguous channels
+FFTWPlan CreateDFTPlan(int length, int channels, int inverse, DFTReal *real, DFTComplex *complex, unsigned int flags)
+{
+	int nc = (length/2)+1;
+	if (inverse)
+		return FFTW(plan_many_dft_c2r)(1,&length,channels,complex,NULL,1,nc,real,NULL,1,length,flags);
+	return FFTW(plan_many_dft_r2c)(1,&length,channels,real,NULL,1,length,complex,NULL,1,nc,flags);
+}
+
+// Sets up FFTW to split each plan created from here on across dftThreads threads
+void InitDFTThreads(void)
+{
+#if DFT_THREADS
+	FFTW(init_threads)();
+	FFTW(plan_with_nthreads)(dftThreads);
+#endif
+}
+
+// Frees the FFTW thread resources. Must be called after every plan is destroyed.
+void DestroyDFTThreads(void)
+{
+#if DFT_THREADS
+	FFTW(cleanup_threads)();
+#endif
+}
+
+// Starts the thread that transforms the second channel while the calling thread transforms the first.
+// Used with concurrentChannelDFTs by the programs that read two tasks.
+void InitChannelDFTWorker(void)
+{
+	sem_init(&channelDFTWorker.start,0,0);
+	sem_init(&channelDFTWorker.done,0,0);
+	pthread_create(&channelDFTWorker.thread,NULL,ChannelDFTWorkerThread,NULL);
+	RestrictToDFTCores(channelDFTWorker.thread);
+	channelDFTWorker.running = 1;
+}
+
+// Stops the channel DFT worker
+void DestroyChannelDFTWorker(void)
+{
+	if (!channelDFTWorker.running)
+		return;
+	channelDFTWorker.stop = 1;
+	sem_post(&channelDFTWorker.start);
+	pthread_join(channelDFTWorker.thread,NULL);
+	sem_destroy(&channelDFTWorker.start);
+	sem_destroy(&channelDFTWorker.done);
+	channelDFTWorker.running = 0;
+}
+
+// Loads and transforms one channel each time StartChannelDFT() posts it
+void *ChannelDFTWorkerThread(void *arg)
+{
+	ChannelDFTWorker *worker = &channelDFTWorker;
+
+	// The worker executes the callback's plan at the same time as the callback, so the built-in FFT gives it its own work buffers
+	dftWorkSlot = 1;
+	while (1)
+	{
+		sem_wait(&worker->start);
+		if (worker->stop)
+			break;
+		if ((void*)worker->input != (void*)worker->data)
+			StoreData(worker->length,1,worker->data,dftWindow,worker->input);
+		ExecuteDFT(worker->plan,worker->input,worker->output);
+		sem_post(&worker->done);
+	}
+	return NULL;
+}
+
+// Hands a channel to the worker thread. Executing a plan on new arrays is thread safe, so the worker can share the callback's plan.
+void StartChannelDFT(DFTPlan plan, int length, double *data, DFTReal *input, DFTComplex *output)
+{
+	channelDFTWorker.plan = plan;
+	channelDFTWorker.length = length;
+	channelDFTWorker.data = data;
+	channelDFTWorker.input = input;
+	channelDFTWorker.output = output;
+	sem_post(&channelDFTWorker.start);
+}
+
+// Waits until the worker thread has transformed its channel
+void WaitForChannelDFT(void)
+{
+	sem_wait(&channelDFTWorker.done);
+}
+
+// Restricts a thread to the cores in dftCoreMask. Threads it creates afterwards, such as the FFTW threads, inherit the restriction.
+void RestrictToDFTCores(pthread_t thread)
+{
+	if (dftCoreMask == 0)
+		return;
+	cpu_set_t cores;
+	CPU_ZERO(&cores);
+	for (int core = 0; core < (int)(8 * sizeof(dftCoreMask)); core++)
+	{
+		if (dftCoreMask & (1UL << core))
+			CPU_SET(core,&cores);
+	}
+	if (pthread_setaffinity_np(thread,sizeof(cores),&cores) != 0)
+		printf("Unable to restrict the DFT threads to the cores in dftCoreMask\n");
+}
+
+// FFTW (3.3.5 and later) starts its worker threads the first time a threaded plan is executed and reuses them for every
+// plan after that, and a thread inherits the cores of the thread that starts it. Executes the plan once on the DFT cores,
+// so the workers are restricted to them, then lifts the restriction from the calling thread again.
+void RestrictDFTThreadPool(DFTPlan plan, DFTReal *real, DFTComplex *complex)
+{
+#if DFT_THREADS
+	cpu_set_t cores;
+	if (dftCoreMask == 0 || plan == NULL || pthread_getaffinity_np(pthread_self(),sizeof(cores),&cores) != 0)
+		return;
+	RestrictToDFTCores(pthread_self());
+	ExecuteDFT(plan,real,complex);
+	pthread_setaffinity_np(pthread_self(),sizeof(cores),&cores);
+#endif
+}
+
+// Times the batched DFT of every channel of blocks from 1024 samples up to maxLength with one thread and with dftThreads threads,
+// and prints the block length from which splitting the DFT across threads is faster
+void RunDFTThreadBenchmark(int maxLength, int channels)
+{
+#if DFT_THREADS
+	int crossover = 0;
+	printf("\nDFT thread benchmark (ms per DFT)\nLength\t\t1 thread\t%d threads\tSpeedup\n",dftThreads);
+	for (int length = maxLength < 1024 ? maxLength : 1024; ; length = length * 4 < maxLength ? length * 4 : maxLength)
+	{
+		DFTReal *input = (DFTReal*)FFTW(malloc)(sizeof(DFTReal) * length * channels);
+		DFTComplex *output = (DFTComplex*)FFTW(malloc)(sizeof(DFTComplex) * ((length/2)+1) * channels);
+		double msPerDFT[2];
+		for (int threads = 0; threads < 2; threads++)
+		{
+			FFTW(plan_with_nthreads)(threads == 0 ? 1 : dftThreads);
+			FFTWPlan plan = CreateDFTPlan(length,channels,0,input,output,FFTW_ESTIMATE);
+			for (int i = 0; i < length * channels; i++)
+				input[i] = sin(0.1 * i);
+
+			// Repeat the DFT for at least 0.1 s
+			struct timespec start, end;
+			double elapsed = 0;
+			int runs = 0;
+			clock_gettime(CLOCK_MONOTONIC,&start);
+			while (elapsed < 0.1 || runs < 3)
+			{
+				FFTW(execute)(plan);
+				runs++;
+				clock_gettime(CLOCK_MONOTONIC,&end);
+				elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+			}
+			msPerDFT[threads] = 1000 * elapsed / runs;
+			FFTW(destroy_plan)(plan);
+		}
+		FFTW(free)(input);
+		FFTW(free)(output);
+
+		// The crossover is the shortest length from which every longer block is faster with threads
+		double speedup = msPerDFT[0] / msPerDFT[1];
+		printf("%d\t\t%1.3f\t\t%1.3f\t\t%1.2f\n",length,msPerDFT[0],msPerDFT[1],speedup);
+		if (speedup <= 1)
+			crossover = 0;
+		else if (crossover == 0)
+			crossover = length;
+		if (length == maxLength)
+			break;
+	}
+	if (crossover > 0)
+		printf("%d threads pay off from %d samples per channel\n",dftThreads,crossover);
+	else
+		printf("%d threads do not pay off up to %d samples per channel\n",dftThreads,maxLength);
+	FFTW(plan_with_nthreads)(dftThreads);
+#else
+	printf("\nThe DFT thread benchmark requires a build with DFT_THREADS\n");
+#endif
+}
+
+// Destroys every plan in the DFT plan cache
+void DestroyDFTPlanCache(void)
+{
+	for (int i = 0; i < dftPlanCache.count; i++)
+	{
+		if (dftPlanCache.entries[i].fftwPlan != NULL)
+			FFTW(destroy_plan)(dftPlanCache.entries[i].fftwPlan);
+	}
+	dftPlanCache.count = 0;
+	dftPlanCache.acquiring = 0;
+}
+
+// Evaluates numBins consecutive DFT bins, starting at firstBin, with the Goertzel algorithm. Only every "stride"-th
+// element of data is used, multiplied by the window if it is not NULL. All bins are advanced together in the inner loop so the compiler can vectorise it.
+void GoertzelBins(double *data, DFTReal *window, int stride, int length, int firstBin, int numBins, DFTComplex *output)
+{
+	double coeff[numBins], cosine[numBins], sine[numBins], s1[numBins], s2[numBins];
+
+	for (int b = 0; b < numBins; b++)
+	{
+		double w = 2 * PI * (firstBin + b) / length;
+		cosine[b] = cos(w);
+		sine[b] = sin(w);
+		coeff[b] = 2 * cosine[b];
+		s1[b] = 0;
+		s2[b] = 0;
+	}
+
+	// Run the Goertzel recurrence of every bin over the samples
+	for (int i = 0; i < length; i++)
+	{
+		double sample = window != NULL ? data[i*stride] * window[i] : data[i*stride];
+		for (int b = 0; b < numBins; b++)
+		{
+			double s0 = sample + coeff[b] * s1[b] - s2[b];
+			s2[b] = s1[b];
+			s1[b] = s0;
+		}
+	}
+
+	// X[k] = e^(jw)*s1 - s2, which matches the output of the FFTW plans
+	for (int b = 0; b < numBins; b++)
+	{
+		output[b][REAL] = cosine[b] * s1[b] - s2[b];
+		output[b][IMAG] = sine[b] * s1[b];
+	}
+}
+
+// Checks that the tracked bin is still the peak of the evaluated bins and has not lost too much magnitude.
+// The bins of channel c are outputs[c][0..numBins-1]. Tracking stops if the tone has moved.
+int ToneStillTracked(DFTComplex **outputs, int numChannels, int firstBin, int numBins)
+{
+	int peakBin = firstBin;
+	double peakPower = -1;
+
+	// Find the bin where every channel is at least as strong as the strongest DSA bin so far
+	for (int b = 0; b < numBins; b++)
+	{
+		double dsaPower = (outputs[0][b][REAL]*outputs[0][b][REAL]) + (outputs[0][b][IMAG]*outputs[0][b][IMAG]);
+		int allAbovePeak = 1;
+		for (int c = 0; c < numChannels; c++)
+		{
+			if (outputs[c][b][REAL]*outputs[c][b][REAL] + outputs[c][b][IMAG]*outputs[c][b][IMAG] < peakPower)
+				allAbovePeak = 0;
+		}
+		if (allAbovePeak)
+		{
+			peakPower = dsaPower;
+			peakBin = firstBin + b;
+		}
+	}
+
+	if (peakBin == toneTracker.bin && sqrt(peakPower) >= trackingMagnitudeDrop * toneTracker.lockedMagnitude)
+		return 1;
+
+	// The tone moved: go back to full DFTs until it is stable again
+	toneTracker.locked = 0;
+	toneTracker.stableBlocks = 0;
+	return 0;
+}
+
+// Counts how many consecutive blocks the peak stayed in the same bin and starts tracking it once it is stable
+void UpdateToneTracker(int peakBin, double peakMagnitude)
+{
+	if (toneTracker.locked)
+		return;
+
+	if (peakBin == toneTracker.candidateBin)
+		toneTracker.stableBlocks++;
+	else
+	{
+		toneTracker.candidateBin = peakBin;
+		toneTracker.stableBlocks = 1;
+	}
+
+	// Never track the DC bin
+	if (peakBin > 0 && toneTracker.stableBlocks >= trackingLockBlocks)
+	{
+		toneTracker.locked = 1;
+		toneTracker.bin = peakBin;
+		toneTracker.lockedMagnitude = peakMagnitude;
+	}
+}
+
+// Calculates a single DFT bin in double precision directly from the samples (every "stride"-th element of data),
+// multiplied by the window if it is not NULL. The twiddle is advanced by a recursive oscillator, a complex rotation
+// per sample, and reseeded from cos and sin every DFT_BIN_RESEED_SAMPLES samples to stop its rounding error growing.
+void DFTBin(double *data, DFTReal *window, int stride, int length, int bin, double *realComp, double *imagComp)
+{
+	double re = 0, im = 0;
+	double stepCos = cos(2 * PI * bin / length), stepSin = -sin(2 * PI * bin / length);
+	double twiddleCos = 1, twiddleSin = 0;
+	for (int i = 0; i < length; i++)
+	{
+		// Reduce the angle modulo 2*pi before the trig calls to keep it accurate for long blocks
+		if (i % DFT_BIN_RESEED_SAMPLES == 0)
+		{
+			double angle = -2 * PI * (double)(((long long)bin * i) % length) / length;
+			twiddleCos = cos(angle);
+			twiddleSin = sin(angle);
+		}
+		double sample = window != NULL ? data[i*stride] * window[i] : data[i*stride];
+		re += sample * twiddleCos;
+		im += sample * twiddleSin;
+		double nextCos = twiddleCos * stepCos - twiddleSin * stepSin;
+		twiddleSin = twiddleCos * stepSin + twiddleSin * stepCos;
+		twiddleCos = nextCos;
+	}
+	*realComp = re;
+	*imagComp = im;
+}
+
+// Returns 1 if the float32 phase skew of this block should be compared against float64, which is every
+// precisionCheckBlocks-th block starting with the first. Called once per block.
+int PrecisionCheckDue(void)
+{
+	return precisionReport.blocksSeen++ % (precisionCheckBlocks > 0 ? precisionCheckBlocks : 1) == 0;
+}
+
+// Calculates the phase skew at the given bin in double precision and records how far phaseSkewDeg is from it
+void ComparePhaseSkewPrecision(double *dsaData, double *mioData, int stride, int length, int bin, double phaseSkewDeg)
+{
+	double dsaRealComp, dsaImagComp, mioRealComp, mioImagComp;
+	DFTBin(dsaData,dftWindow,stride,length,bin,&dsaRealComp,&dsaImagComp);
+	DFTBin(mioData,dftWindow,stride,length,bin,&mioRealComp,&mioImagComp);
+
+	double dsaPhase = atan2(dsaImagComp,dsaRealComp) * (180/PI);
+	double mioPhase = atan2(mioImagComp,mioRealComp) * (180/PI);
+	double error = fabs(NormalizePhaseAngleDifference(dsaPhase-mioPhase) - phaseSkewDeg);
+	if (error > 180)
+		error = 360 - error;
+
+	precisionReport.blocks++;
+	if (error > precisionReport.maxPhaseSkewErrorDeg)
+		precisionReport.maxPhaseSkewErrorDeg = error;
+	if (error > phaseSkewToleranceDeg)
+		precisionReport.blocksOverTolerance++;
+}
+
+// Creates the window applied to the samples as they are loaded into the DFT, and its coherent and noise power gains.
+// The interpolated estimator requires a Hann window.
+void InitDFTWindow(int length)
+{
+	const char *windowNames[] = {"none", "Hann", "Blackman-Harris", "flat-top", "Kaiser"};
+	int type = interpolatedEstimator ? DFT_WINDOW_HANN : dftWindowType;
+	if (interpolatedEstimator && dftWindowType != DFT_WINDOW_NONE && dftWindowType != DFT_WINDOW_HANN)
+		printf("The interpolated estimator requires a Hann window, so dftWindowType is ignored\n");
+	if (type == DFT_WINDOW_NONE)
+		return;
+
+	// Periodic windows, so the window of a block lines up with the DFT bins
+	double sum = 0, sumOfSquares = 0;
+	dftWindow = (DFTReal*)FFTW(malloc)(sizeof(DFTReal) * length);
+	for (int i = 0; i < length; i++)
+	{
+		dftWindow[i] = WindowValue(type,i,length);
+		sum += dftWindow[i];
+		sumOfSquares += dftWindow[i] * dftWindow[i];
+	}
+	dftWindowCoherentGain = sum / length;
+	dftWindowNoiseGain = sumOfSquares / length;
+	printf("DFT window: %s, coherent gain %1.4f, noise power gain %1.4f, noise bandwidth %1.2f bins\n",windowNames[type],dftWindowCoherentGain,dftWindowNoiseGain,dftWindowNoiseGain/(dftWindowCoherentGain*dftWindowCoherentGain));
+}
+
+// Returns sample i of a periodic window of the given type and length
+double WindowValue(int type, int i, int length)
+{
+	double x = 2 * PI * i / length;
+	double r = 2.0 * i / length - 1;
+	switch (type)
+	{
+		case DFT_WINDOW_HANN:
+			return 0.5 - 0.5 * cos(2 * PI * i / length);
+		case DFT_WINDOW_BLACKMAN_HARRIS:
+			return 0.35875 - 0.48829 * cos(x) + 0.14128 * cos(2*x) - 0.01168 * cos(3*x);
+		case DFT_WINDOW_FLAT_TOP:
+			return 0.21557895 - 0.41663158 * cos(x) + 0.277263158 * cos(2*x) - 0.083578947 * cos(3*x) + 0.006947368 * cos(4*x);
+		case DFT_WINDOW_KAISER:
+			return BesselI0(kaiserBeta * sqrt(1 - r*r)) / BesselI0(kaiserBeta);
+		default:
+			return 1;
+	}
+}
+
+// Calculates the zeroth order modified Bessel function of the first kind, used by the Kaiser window
+double BesselI0(double x)
+{
+	double sum = 1, term = 1;
+	for (int k = 1; k < 50 && term > 1e-12 * sum; k++)
+	{
+		term *= (x / (2*k)) * (x / (2*k));
+		sum += term;
+	}
+	return sum;
+}
+
+// Calculates the magnitude of a DFT bin
+double BinMagnitude(DFTReal *bin)
+{
+	return sqrt((bin[REAL]*bin[REAL]) + (bin[IMAG]*bin[IMAG]));
+}
+
+// Estimates how far, in bins (-1 to 1), a tone lies from the centre of the peak bin using the Hann windowed
+// magnitudes of the peak bin and its neighbours. The phase of the peak bin is off by 180*offset degrees.
+double InterpolateHannPeak(double magnitudeBelow, double magnitudePeak, double magnitudeAbove)
+{
+	double denominator = magnitudeBelow + 2*magnitudePeak + magnitudeAbove;
+	if (denominator <= 0)
+		return 0;
+	return 2 * (magnitudeAbove - magnitudeBelow) / denominator;
+}
+
+// Slides the DFT of the bins around "bin" through a new block one sample at a time, and logs the phase skew of every
+// channel relative to the first channel each slidingHopSize samples. channels[c] points to the first sample of
+// channel c in the block and consecutive samples are "stride" elements apart. The window is the last "length" samples.
+void SlidingDFTBlock(double **channels, int stride, int numChannels, int length, int bin, double sampleRate, FILE *file)
+{
+	double twiddle[SLIDING_BINS][2];
+	double binPrecision = sampleRate / length;
+	int firstBin = bin - SLIDING_BINS/2;
+
+	// Recalculate the DFT of the window from the history when the tracked bin changes, and periodically
+	if (bin != slidingDFTState.bin || slidingDFTState.blocksSinceSync >= slidingResyncBlocks)
+	{
+		for (int c = 0; c < numChannels; c++)
+			for (int b = 0; b < SLIDING_BINS; b++)
+				DFTBin(slidingDFTState.history+c*length,NULL,1,length,firstBin+b,&slidingDFTState.state[c][b][REAL],&slidingDFTState.state[c][b][IMAG]);
+		slidingDFTState.bin = bin;
+		slidingDFTState.blocksSinceSync = 0;
+	}
+	slidingDFTState.blocksSinceSync++;
+
+	// Each step rotates the DFT by e^(j*2*pi*k/N)
+	for (int b = 0; b < SLIDING_BINS; b++)
+	{
+		twiddle[b][REAL] = cos(2 * PI * (firstBin + b) / length);
+		twiddle[b][IMAG] = sin(2 * PI * (firstBin + b) / length);
+	}
+
+	for (int i = 0; i < length; i++)
+	{
+		// Replace the oldest sample of the window with the newest one. History index i holds the sample leaving the window.
+		for (int c = 0; c < numChannels; c++)
+		{
+			double sample = channels[c][i*stride];
+			double change = sample - slidingDFTState.history[c*length+i];
+			slidingDFTState.history[c*length+i] = sample;
+			for (int b = 0; b < SLIDING_BINS; b++)
+			{
+				double re = slidingDFTState.state[c][b][REAL] + change;
+				double im = slidingDFTState.state[c][b][IMAG];
+				slidingDFTState.state[c][b][REAL] = re * twiddle[b][REAL] - im * twiddle[b][IMAG];
+				slidingDFTState.state[c][b][IMAG] = re * twiddle[b][IMAG] + im * twiddle[b][REAL];
+			}
+		}
+
+		if ((i+1) % slidingHopSize != 0 || bin <= 0 || file == NULL)
+			continue;
+
+		// Use the tracked bin directly, or apply the Hann window in the frequency domain and interpolate
+		double bins[MAX_CHANNELS][3][2] = {{{0}}};
+		double delta = 0;
+		for (int c = 0; c < numChannels; c++)
+		{
+			for (int b = 0; b < 3; b++)
+			{
+				double (*state)[2] = slidingDFTState.state[c];
+				int k = SLIDING_BINS/2 - 1 + b;
+				if (interpolatedEstimator)
+				{
+					bins[c][b][REAL] = 0.5 * state[k][REAL] - 0.25 * (state[k-1][REAL] + state[k+1][REAL]);
+					bins[c][b][IMAG] = 0.5 * state[k][IMAG] - 0.25 * (state[k-1][IMAG] + state[k+1][IMAG]);
+				}
+				else
+				{
+					bins[c][b][REAL] = state[k][REAL];
+					bins[c][b][IMAG] = state[k][IMAG];
+				}
+			}
+		}
+		if (interpolatedEstimator)
+		{
+			double below = 0, peak = 0, above = 0;
+			for (int c = 0; c < numChannels; c++)
+			{
+				below += sqrt(bins[c][0][REAL]*bins[c][0][REAL] + bins[c][0][IMAG]*bins[c][0][IMAG]);
+				peak += sqrt(bins[c][1][REAL]*bins[c][1][REAL] + bins[c][1][IMAG]*bins[c][1][IMAG]);
+				above += sqrt(bins[c][2][REAL]*bins[c][2][REAL] + bins[c][2][IMAG]*bins[c][2][IMAG]);
+			}
+			delta = InterpolateHannPeak(below,peak,above);
+		}
+		double freq = (bin + delta) * binPrecision;
+
+		// Log the phase skew of every channel relative to the first channel
+		double dsaPhase = atan2(bins[0][1][IMAG],bins[0][1][REAL]) * (180/PI);
+		fprintf(file,"%0.6f,%5.2f",(slidingDFTState.samplesProcessed + i + 1) / sampleRate,freq);
+		for (int c = 1; c < numChannels; c++)
+		{
+			double phase = atan2(bins[c][1][IMAG],bins[c][1][REAL]) * (180/PI);
+			fprintf(file,",%2.4f,%1.4e",NormalizePhaseAngleDifference(dsaPhase-phase),((dsaPhase-phase)/360) * (1/freq));
+		}
+		fprintf(file,"\n");
+	}
+	slidingDFTState.samplesProcessed += length;
+}
+
+// Adds the spectra of a block to the averages. outputs[c] holds numBins bins of channel c, starting at firstBin.
+// Bins that were not evaluated in this block keep their previous averages.
+void WelchAccumulate(DFTComplex **outputs, int firstBin, int numBins)
+{
+	WelchAverager *welch = &welchAverager;
+
+	// Until 1/welchAlpha blocks have been seen every block has the same weight, so the average does not start biased towards zero.
+	// Without averaging the latest block replaces the spectra.
+	double alpha = welchAveraging != 1 ? 1 : welchAlpha > 1.0 / (welch->blocks + 1) ? welchAlpha : 1.0 / (welch->blocks + 1);
+	int slotOffset = welch->slot * welch->numChannels * welch->numBins;
+
+	for (int c = 0; c < welch->numChannels; c++)
+	{
+		DFTComplex *dsa = outputs[0];
+		DFTComplex *channel = outputs[c];
+		for (int b = 0; b < numBins; b++)
+		{
+			int k = c * welch->numBins + firstBin + b;
+			double autoSpectrum = channel[b][REAL] * channel[b][REAL] + channel[b][IMAG] * channel[b][IMAG];
+			double crossReal = dsa[b][REAL] * channel[b][REAL] + dsa[b][IMAG] * channel[b][IMAG];
+			double crossImag = dsa[b][IMAG] * channel[b][REAL] - dsa[b][REAL] * channel[b][IMAG];
+
+			if (welchAveraging != 2)
+			{
+				welch->autoSpectrum[k] += alpha * (autoSpectrum - welch->autoSpectrum[k]);
+				welch->crossSpectrum[k][REAL] += alpha * (crossReal - welch->crossSpectrum[k][REAL]);
+				welch->crossSpectrum[k][IMAG] += alpha * (crossImag - welch->crossSpectrum[k][IMAG]);
+			}
+			else
+			{
+				// Replace the oldest block in the running sums
+				welch->autoSpectrum[k] += autoSpectrum - welch->autoHistory[slotOffset+k];
+				welch->crossSpectrum[k][REAL] += crossReal - welch->crossHistory[slotOffset+k][REAL];
+				welch->crossSpectrum[k][IMAG] += crossImag - welch->crossHistory[slotOffset+k][IMAG];
+				welch->autoHistory[slotOffset+k] = autoSpectrum;
+				welch->crossHistory[slotOffset+k][REAL] = crossReal;
+				welch->crossHistory[slotOffset+k][IMAG] = crossImag;
+			}
+		}
+	}
+
+	welch->blocks++;
+	if (welchAveraging == 2)
+		welch->slot = (welch->slot + 1) % welchBlocks;
+}
+
+// Returns the phase skew, in degrees, between the first (DSA) channel and "channel" from the averaged cross-spectrum
+double WelchPhaseSkewDeg(int channel, int bin)
+{
+	double *cross = welchAverager.crossSpectrum[channel * welchAverager.numBins + bin];
+	return atan2(cross[IMAG],cross[REAL]) * (180/PI);
+}
+
+// Fits phase = 2*pi*f*skew, weighted by the cross-spectrum magnitude, to the phase of the cross-spectrum between the
+// first (DSA) channel and "channel" at every bin that passes the level and coherence thresholds. The bin selection runs
+// on squared magnitudes in branch free loops the compiler can vectorise, so only the selected bins need atan2.
+// Returns the number of bins used; skewSec is only written if it is nonzero.
+int GroupDelaySkewSec(int channel, double binPrecision, double *skewSec)
+{
+	WelchAverager *welch = &welchAverager;
+	double (*cross)[2] = welch->crossSpectrum + channel * welch->numBins;
+	double *dsaAuto = welch->autoSpectrum;
+	double *channelAuto = welch->autoSpectrum + channel * welch->numBins;
+	double *weight = welch->fitWeight;
+	int lastBin = welch->numBins - 1; // The DC and Nyquist bins have no usable phase
+	double maxPower = 0;
+
+	// Find the strongest bin of the squared cross-spectrum magnitude
+	for (int k = 1; k < lastBin; k++)
+	{
+		weight[k] = cross[k][REAL] * cross[k][REAL] + cross[k][IMAG] * cross[k][IMAG];
+		maxPower = weight[k] > maxPower ? weight[k] : maxPower;
+	}
+
+	// Clear the weight of every bin below the level or coherence threshold. The magnitude squared coherence
+	// |Sxy|^2/(Sxx*Syy) is compared without dividing.
+	double minPower = maxPower * pow(10, groupDelayMinLevelDb / 5);
+	for (int k = 1; k < lastBin; k++)
+	{
+		int coherent = weight[k] >= groupDelayMinCoherence * dsaAuto[k] * channelAuto[k];
+		weight[k] = (weight[k] >= minPower && coherent) ? sqrt(weight[k]) : 0;
+	}
+
+	// Collect the selected bins
+	int used = 0;
+	for (int k = 1; k < lastBin; k++)
+	{
+		if (weight[k] > 0)
+			welch->fitBins[used++] = k;
+	}
+	if (used == 0)
+		return 0;
+
+	// Unwrap the phase across the selected bins and accumulate the weighted least squares sums of a line through the origin
+	double previousPhase = 0, sumWeightedProduct = 0, sumWeightedSquare = 0;
+	for (int i = 0; i < used; i++)
+	{
+		int k = welch->fitBins[i];
+		double phase = atan2(cross[k][IMAG],cross[k][REAL]);
+		phase += 2 * PI * round((previousPhase - phase) / (2 * PI));
+		previousPhase = phase;
+
+		double omega = 2 * PI * k * binPrecision;
+		sumWeightedProduct += weight[k] * omega * phase;
+		sumWeightedSquare += weight[k] * omega * omega;
+	}
+	*skewSec = sumWeightedProduct / sumWeightedSquare;
+	return used;
+}
+
+// Measures the delay, in samples, of every channel behind the first (DSA) channel from the spectra in outputs[c]
+// with the GCC-PHAT method. The cross-spectra of all channels are transformed back with one batched inverse DFT.
+// delays[0] is not written. Returns 0, without writing delays, if the DFT plan cache had no plan for the inverse DFT.
+int GccPhatDelays(DFTComplex **outputs, int numChannels, int length, double *delays)
+{
+	int nc = (length/2)+1;
+	int pairs = numChannels - 1;
+	DFTComplex *cross = gccPhatState.cross;
+	DFTReal *correlation = gccPhatState.correlation;
+	DFTPlan plan = GetDFTPlan(length,pairs,1,correlation,cross);
+	if (plan == NULL)
+		return 0;
+
+	for (int c = 1; c < numChannels; c++)
+		PhatCrossSpectrum(outputs[0],outputs[c],nc,cross+(c-1)*nc);
+	ExecuteInverseDFT(plan,cross,correlation);
+
+	for (int c = 1; c < numChannels; c++)
+		delays[c] = CorrelationPeakDelay(correlation+(c-1)*length,1,length);
+	return 1;
+}
+
+// Stores the cross-spectrum X0*conj(Xc) scaled to unit magnitude (PHAT weighting), so every bin contributes equally
+// to the cross-correlation and its peak stays sharp whatever the spectrum of the signal
+void PhatCrossSpectrum(DFTComplex *dsa, DFTComplex *channel, int numBins, DFTComplex *cross)
+{
+	for (int k = 0; k < numBins; k++)
+	{
+		DFTReal crossReal = dsa[k][REAL] * channel[k][REAL] + dsa[k][IMAG] * channel[k][IMAG];
+		DFTReal crossImag = dsa[k][IMAG] * channel[k][REAL] - dsa[k][REAL] * channel[k][IMAG];
+		DFTReal magnitude = DFT_SQRT(crossReal * crossReal + crossImag * crossImag);
+		DFTReal scale = magnitude > 0 ? 1 / magnitude : 0;
+		cross[k][REAL] = crossReal * scale;
+		cross[k][IMAG] = crossImag * scale;
+	}
+}
+
+// Finds the peak of the circular cross-correlation (every "stride"-th element) and refines it between samples with a
+// parabola through the peak and its neighbours. Returns the delay, in samples, of the channel behind the DSA channel.
+double CorrelationPeakDelay(DFTReal *correlation, int stride, int length)
+{
+	int peak = 0;
+	for (int m = 1; m < length; m++)
+	{
+		if (correlation[m*stride] > correlation[peak*stride])
+			peak = m;
+	}
+
+	double below = correlation[((peak + length - 1) % length) * stride];
+	double centre = correlation[peak * stride];
+	double above = correlation[((peak + 1) % length) * stride];
+	double curvature = below - 2 * centre + above;
+	double offset = curvature < 0 ? 0.5 * (below - above) / curvature : 0;
+
+	// The correlation peaks at minus the delay, wrapped into the block
+	double lag = peak + offset;
+	if (lag > length / 2)
+		lag -= length;
+	return -lag;
+}
+
+// Calculates the magnitude and amplitude of numBins bins of every channel in one pass and returns the offset of the peak
+// bin, the bin at which the weakest channel is strongest. The peak is found from the squared magnitudes, so square roots
+// are only taken when magnitudes is not NULL, in which case magnitudes[c][i] and amplitudes[c][i] are filled in.
+int SpectrumKernel(DFTComplex **outputs, int numChannels, int numBins, DFTReal amplitudeScale, DFTReal **magnitudes, DFTReal **amplitudes)
+{
+#if SPECTRUM_AVX2
+	if (__builtin_cpu_supports("avx2"))
+		return SpectrumKernelAVX2(outputs,numChannels,numBins,amplitudeScale,magnitudes,amplitudes);
+#elif SPECTRUM_NEON
+	return SpectrumKernelNEON(outputs,numChannels,numBins,amplitudeScale,magnitudes,amplitudes);
+#endif
+	return SpectrumKernelScalar(outputs,numChannels,numBins,amplitudeScale,magnitudes,amplitudes,0,0,-1);
+}
+
+// Scalar spectrum kernel. Starts at firstBin with the peak found so far, so the vector kernels can finish the bins
+// left over at the end of the spectra with it. Ties keep the lower bin.
+int SpectrumKernelScalar(DFTComplex **outputs, int numChannels, int numBins, DFTReal amplitudeScale, DFTReal **magnitudes, DFTReal **amplitudes, int firstBin, int peak, DFTReal peakPower)
+{
+	for (int i = firstBin; i < numBins; i++)
+	{
+		DFTReal weakest = 0;
+		for (int c = 0; c < numChannels; c++)
+		{
+			DFTReal power = (outputs[c][i][REAL]*outputs[c][i][REAL]) + (outputs[c][i][IMAG]*outputs[c][i][IMAG]);
+			if (c == 0 || power < weakest)
+				weakest = power;
+			if (magnitudes != NULL)
+			{
+				magnitudes[c][i] = DFT_SQRT(power);
+				amplitudes[c][i] = magnitudes[c][i] * amplitudeScale;
+			}
+		}
+		if (weakest > peakPower)
+		{
+			peakPower = weakest;
+			peak = i;
+		}
+	}
+	return peak;
+}
+
+#if SPECTRUM_AVX2
+// AVX2 spectrum kernel. Each iteration loads 4 (double) or 8 (float) interleaved complex bins of every channel,
+// squares and pairwise adds them into consecutive powers, and keeps the strongest weakest-channel power seen in each lane.
+__attribute__((target("avx2")))
+int SpectrumKernelAVX2(DFTComplex **outputs, int numChannels, int numBins, DFTReal amplitudeScale, DFTReal **magnitudes, DFTReal **amplitudes)
+{
+#if DFT_SINGLE_PRECISION
+	const int lanes = 8;
+	__m256 scale = _mm256_set1_ps(amplitudeScale);
+	__m256 best = _mm256_set1_ps(-1);
+	__m256 bestBin = _mm256_setzero_ps();
+	__m256 bin = _mm256_setr_ps(0,1,2,3,4,5,6,7);
+	__m256 step = _mm256_set1_ps(lanes);
+#else
+	const int lanes = 4;
+	__m256d scale = _mm256_set1_pd(amplitudeScale);
+	__m256d best = _mm256_set1_pd(-1);
+	__m256d bestBin = _mm256_setzero_pd();
+	__m256d bin = _mm256_setr_pd(0,1,2,3);
+	__m256d step = _mm256_set1_pd(lanes);
+#endif
+	int i = 0;
+	for (; i + lanes <= numBins; i += lanes)
+	{
+#if DFT_SINGLE_PRECISION
+		__m256 weakest = _mm256_setzero_ps();
+		for (int c = 0; c < numChannels; c++)
+		{
+			__m256 low = _mm256_loadu_ps(outputs[c][i]);
+			__m256 high = _mm256_loadu_ps(outputs[c][i+4]);
+			__m256 power = _mm256_hadd_ps(_mm256_mul_ps(low,low),_mm256_mul_ps(high,high));
+			power = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(power),0xD8));
+			weakest = c == 0 ? power : _mm256_min_ps(weakest,power);
+			if (magnitudes != NULL)
+			{
+				__m256 magnitude = _mm256_sqrt_ps(power);
+				_mm256_storeu_ps(magnitudes[c] + i,magnitude);
+				_mm256_storeu_ps(amplitudes[c] + i,_mm256_mul_ps(magnitude,scale));
+			}
+		}
+		__m256 stronger = _mm256_cmp_ps(weakest,best,_CMP_GT_OQ);
+		best = _mm256_blendv_ps(best,weakest,stronger);
+		bestBin = _mm256_blendv_ps(bestBin,bin,stronger);
+		bin = _mm256_add_ps(bin,step);
+#else
+		__m256d weakest = _mm256_setzero_pd();
+		for (int c = 0; c < numChannels; c++)
+		{
+			__m256d low = _mm256_loadu_pd(outputs[c][i]);
+			__m256d high = _mm256_loadu_pd(outputs[c][i+2]);
+			__m256d power = _mm256_hadd_pd(_mm256_mul_pd(low,low),_mm256_mul_pd(high,high));
+			power = _mm256_permute4x64_pd(power,0xD8);
+			weakest = c == 0 ? power : _mm256_min_pd(weakest,power);
+			if (magnitudes != NULL)
+			{
+				__m256d magnitude = _mm256_sqrt_pd(power);
+				_mm256_storeu_pd(magnitudes[c] + i,magnitude);
+				_mm256_storeu_pd(amplitudes[c] + i,_mm256_mul_pd(magnitude,scale));
+			}
+		}
+		__m256d stronger = _mm256_cmp_pd(weakest,best,_CMP_GT_OQ);
+		best = _mm256_blendv_pd(best,weakest,stronger);
+		bestBin = _mm256_blendv_pd(bestBin,bin,stronger);
+		bin = _mm256_add_pd(bin,step);
+#endif
+	}
+
+	// Reduce the lanes to the strongest bin, keeping the lower bin on ties
+	DFTReal laneBest[8], laneBin[8];
+#if DFT_SINGLE_PRECISION
+	_mm256_storeu_ps(laneBest,best);
+	_mm256_storeu_ps(laneBin,bestBin);
+#else
+	_mm256_storeu_pd(laneBest,best);
+	_mm256_storeu_pd(laneBin,bestBin);
+#endif
+	int peak = 0;
+	DFTReal peakPower = -1;
+	for (int l = 0; l < lanes; l++)
+	{
+		if (laneBest[l] > peakPower || (laneBest[l] == peakPower && (int)laneBin[l] < peak))
+		{
+			peakPower = laneBest[l];
+			peak = (int)laneBin[l];
+		}
+	}
+	return SpectrumKernelScalar(outputs,numChannels,numBins,amplitudeScale,magnitudes,amplitudes,i,peak,peakPower);
+}
+#endif
+
+#if SPECTRUM_NEON
+// NEON spectrum kernel. Each iteration deinterleaves 4 complex bins of every channel into real and imaginary vectors.
+// ARMv7 has no vector square root, so the magnitudes are the power times its reciprocal square root, refined twice.
+int SpectrumKernelNEON(DFTComplex **outputs, int numChannels, int numBins, DFTReal amplitudeScale, DFTReal **magnitudes, DFTReal **amplitudes)
+{
+	const int lanes = 4;
+	const float32x4_t zero = vdupq_n_f32(0);
+	float32x4_t best = vdupq_n_f32(-1);
+	float32x4_t bestBin = zero;
+	float32x4_t bin = {0,1,2,3};
+	float32x4_t step = vdupq_n_f32(lanes);
+	int i = 0;
+	for (; i + lanes <= numBins; i += lanes)
+	{
+		float32x4_t weakest = zero;
+		for (int c = 0; c < numChannels; c++)
+		{
+			float32x4x2_t bins = vld2q_f32(outputs[c][i]);
+			float32x4_t power = vmlaq_f32(vmulq_f32(bins.val[0],bins.val[0]),bins.val[1],bins.val[1]);
+			weakest = c == 0 ? power : vminq_f32(weakest,power);
+			if (magnitudes != NULL)
+			{
+#if defined(__aarch64__)
+				float32x4_t magnitude = vsqrtq_f32(power);
+#else
+				float32x4_t reciprocal = vrsqrteq_f32(power);
+				reciprocal = vmulq_f32(reciprocal,vrsqrtsq_f32(vmulq_f32(power,reciprocal),reciprocal));
+				reciprocal = vmulq_f32(reciprocal,vrsqrtsq_f32(vmulq_f32(power,reciprocal),reciprocal));
+				float32x4_t magnitude = vbslq_f32(vcgtq_f32(power,zero),vmulq_f32(power,reciprocal),zero);
+#endif
+				vst1q_f32(magnitudes[c] + i,magnitude);
+				vst1q_f32(amplitudes[c] + i,vmulq_n_f32(magnitude,amplitudeScale));
+			}
+		}
+		uint32x4_t stronger = vcgtq_f32(weakest,best);
+		best = vbslq_f32(stronger,weakest,best);
+		bestBin = vbslq_f32(stronger,bin,bestBin);
+		bin = vaddq_f32(bin,step);
+	}
+
+	// Reduce the lanes to the strongest bin, keeping the lower bin on ties
+	float laneBest[4], laneBin[4];
+	vst1q_f32(laneBest,best);
+	vst1q_f32(laneBin,bestBin);
+	int peak = 0;
+	float peakPower = -1;
+	for (int l = 0; l < lanes; l++)
+	{
+		if (laneBest[l] > peakPower || (laneBest[l] == peakPower && (int)laneBin[l] < peak))
+		{
+			peakPower = laneBest[l];
+			peak = (int)laneBin[l];
+		}
+	}
+	return SpectrumKernelScalar(outputs,numChannels,numBins,amplitudeScale,magnitudes,amplitudes,i,peak,peakPower);
+}
+#endif
+
+// Returns the name of the spectrum kernel SpectrumKernel() runs on this controller
+const char *SpectrumKernelName(void)
+{
+#if SPECTRUM_AVX2
+	if (__builtin_cpu_supports("avx2"))
+		return "AVX2";
+#elif SPECTRUM_NEON
+	return "NEON";
+#endif
+	return "scalar";
+}
+
+// The per-bin loop DFT() used before SpectrumKernel(), kept as the baseline for the spectrum kernel benchmark. It takes
+// the square root of every bin and compares the magnitudes against an integer, so peaks below 1 are missed.
+int PerBinSpectrumLoop(DFTComplex **outputs, int numChannels, int numBins, DFTReal amplitudeScale, DFTReal **magnitudes, DFTReal **amplitudes)
+{
+	int maxMagnitudeIndex = 0;
+	int maxMagnitude = 0;
+	for (int i = 0; i < numBins; i++)
+	{
+		DFTReal dsaMagnitude = 0;
+		int allAboveMax = 1;
+		for (int c = 0; c < numChannels; c++)
+		{
+			DFTReal realComp = outputs[c][i][REAL];
+			DFTReal imagComp = outputs[c][i][IMAG];
+			magnitudes[c][i] = DFT_SQRT((realComp*realComp) + (imagComp*imagComp));
+			amplitudes[c][i] = magnitudes[c][i] * amplitudeScale;
+			if (c == 0)
+				dsaMagnitude = magnitudes[c][i];
+			if (magnitudes[c][i] < maxMagnitude)
+				allAboveMax = 0;
+		}
+		if (allAboveMax)
+		{
+			maxMagnitude = dsaMagnitude;
+			maxMagnitudeIndex = i;
+		}
+	}
+	return maxMagnitudeIndex;
+}
+
+// Times the per-bin loop and the spectrum kernel, with and without magnitudes, on spectra of 1k, 64k and 1M bins
+void RunSpectrumKernelBenchmark(int numChannels)
+{
+	const int benchmarkBins[3] = {1024, 65536, 1048576};
+	printf("\nSpectrum kernel benchmark (%s, %d channels, ms per pass)\nBins\t\tPer-bin loop\tKernel\t\tSpeedup\t\tPeak only\tSpeedup\n",SpectrumKernelName(),numChannels);
+	for (int b = 0; b < 3; b++)
+	{
+		int numBins = benchmarkBins[b];
+		DFTComplex *outputs[numChannels];
+		DFTReal *magnitudes[numChannels], *amplitudes[numChannels];
+		for (int c = 0; c < numChannels; c++)
+		{
+			outputs[c] = (DFTComplex*)FFTW(malloc)(sizeof(DFTComplex) * numBins);
+			magnitudes[c] = (DFTReal*)FFTW(malloc)(sizeof(DFTReal) * numBins);
+			amplitudes[c] = (DFTReal*)FFTW(malloc)(sizeof(DFTReal) * numBins);
+			for (int i = 0; i < numBins; i++)
+			{
+				outputs[c][i][REAL] = sin(0.1 * i + c);
+				outputs[c][i][IMAG] = cos(0.3 * i + c);
+			}
+		}
+
+		// Repeat each pass for at least 0.1 s
+		double msPerPass[3];
+		int peaks[3];
+		for (int kernel = 0; kernel < 3; kernel++)
+		{
+			struct timespec start, end;
+			double elapsed = 0;
+			int runs = 0;
+			clock_gettime(CLOCK_MONOTONIC,&start);
+			while (elapsed < 0.1 || runs < 3)
+			{
+				if (kernel == 0)
+					peaks[kernel] = PerBinSpectrumLoop(outputs,numChannels,numBins,1,magnitudes,amplitudes);
+				else
+					peaks[kernel] = SpectrumKernel(outputs,numChannels,numBins,1,kernel == 1 ? magnitudes : NULL,amplitudes);
+				runs++;
+				clock_gettime(CLOCK_MONOTONIC,&end);
+				elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+			}
+			msPerPass[kernel] = 1000 * elapsed / runs;
+		}
+		printf("%d\t\t%1.3f\t\t%1.3f\t\t%1.2f\t\t%1.3f\t\t%1.2f\n",numBins,msPerPass[0],msPerPass[1],msPerPass[0]/msPerPass[1],msPerPass[2],msPerPass[0]/msPerPass[2]);
+		int scalarPeak = SpectrumKernelScalar(outputs,numChannels,numBins,1,NULL,NULL,0,0,-1);
+		if (peaks[1] != scalarPeak || peaks[2] != scalarPeak)
+			printf("WARNING: the spectrum kernel found bin %d (bin %d without magnitudes) instead of bin %d\n",peaks[1],peaks[2],scalarPeak);
+
+		for (int c = 0; c < numChannels; c++)
+		{
+			FFTW(free)(outputs[c]);
+			FFTW(free)(magnitudes[c]);
+			FFTW(free)(amplitudes[c]);
+		}
+	}
+}
+
+// Measures the distortion of one channel from its spectrum. The fundamental is the strongest bin within
+// harmonicLeakageBins of peakBin, and the power of the fundamental and of each harmonic is summed over
+// harmonicLeakageBins bins on either side of its peak so the energy leaked into neighbouring bins is counted.
+// Harmonics above Nyquist are folded back to the bins they alias to. DC and its leakage are left out of every sum.
+// Every power is floored at HARMONIC_POWER_FLOOR of the total power, so a silent channel or a spectrum without harmonics
+// or spurs gives finite ratios. The ENOB is corrected to a full-scale signal (IEEE 1241): a fundamental of amplitude A on
+// a range of fullScaleVolts peak loses 20*log10(fullScaleVolts/A) dB of SINAD to the unused range, which is added back.
+void AnalyzeHarmonics(DFTComplex *spectrum, int length, int peakBin, double binPrecision, double fullScaleVolts, HarmonicResult *result)
+{
+	int nc = (length/2)+1;
+	int leak = harmonicLeakageBins;
+
+	// Total power of everything but DC
+	double totalPower = 0;
+	for (int b = leak + 1; b < nc; b++)
+		totalPower += BinPower(spectrum,b,length);
+
+	// Fundamental
+	int fundamental = StrongestBinNear(spectrum,length,peakBin,leak);
+	double fundamentalPower = BandPower(spectrum,length,fundamental,leak);
+
+	// Harmonics. A harmonic that aliases onto DC, the fundamental or a harmonic already counted is skipped.
+	int bands[numHarmonics + 1];
+	int numBands = 1;
+	double harmonicPower = 0;
+	bands[0] = fundamental;
+	for (int h = 2; h <= numHarmonics + 1; h++)
+	{
+		int bin = (int)(((long long)h * fundamental) % length);
+		if (bin > length/2)
+			bin = length - bin;
+		bin = StrongestBinNear(spectrum,length,bin,leak);
+
+		int overlaps = bin <= 2 * leak;
+		for (int k = 0; k < numBands; k++)
+			if (abs(bin - bands[k]) <= 2 * leak)
+				overlaps = 1;
+		if (overlaps)
+			continue;
+		bands[numBands++] = bin;
+		harmonicPower += BandPower(spectrum,length,bin,leak);
+	}
+
+	// The largest spur is the strongest bin outside DC and the fundamental
+	double spurPower = 0;
+	for (int b = leak + 1; b < nc; b++)
+	{
+		if (abs(b - fundamental) > leak && BinPower(spectrum,b,length) > spurPower)
+			spurPower = BinPower(spectrum,b,length);
+	}
+
+	// The band power of a tone of amplitude A is (A*length/2)^2 times the noise power gain of the window
+	double powerFloor = totalPower * HARMONIC_POWER_FLOOR + DBL_MIN;
+	double noiseAndDistortion = totalPower - fundamentalPower;
+	result->fundamentalFreq = fundamental * binPrecision;
+	result->fundamentalAmplitude = 2 * sqrt(fundamentalPower / dftWindowNoiseGain) / length;
+	result->thdDb = 10 * log10((harmonicPower + powerFloor) / (fundamentalPower + powerFloor));
+	result->sinadDb = 10 * log10((fundamentalPower + powerFloor) / (noiseAndDistortion > 0 ? noiseAndDistortion + powerFloor : powerFloor));
+	result->sfdrDb = 10 * log10((BinPower(spectrum,fundamental,length) + powerFloor) / (spurPower + powerFloor));
+	result->enob = (result->sinadDb - 1.76) / 6.02;
+	if (fullScaleVolts > 0 && result->fundamentalAmplitude > 0)
+		result->enob += 20 * log10(fullScaleVolts / result->fundamentalAmplitude) / 6.02;
+}
+
+// Returns the power of one bin of a one-sided spectrum. The Nyquist bin of an even length has no negative frequency
+// counterpart, so it counts half as much as the others.
+double BinPower(DFTComplex *spectrum, int bin, int length)
+{
+	double power = (spectrum[bin][REAL]*spectrum[bin][REAL]) + (spectrum[bin][IMAG]*spectrum[bin][IMAG]);
+	return 2 * bin == length ? power / 2 : power;
+}
+
+// Returns the strongest bin within range bins of bin
+int StrongestBinNear(DFTComplex *spectrum, int length, int bin, int range)
+{
+	int nc = (length/2)+1;
+	int strongest = bin;
+	for (int b = bin - range > 0 ? bin - range : 0; b <= bin + range && b < nc; b++)
+	{
+		if (BinPower(spectrum,b,length) > BinPower(spectrum,strongest,length))
+			strongest = b;
+	}
+	return strongest;
+}
+
+// Returns the power summed over range bins on either side of bin
+double BandPower(DFTComplex *spectrum, int length, int bin, int range)
+{
+	int nc = (length/2)+1;
+	double power = 0;
+	for (int b = bin - range > 0 ? bin - range : 0; b <= bin + range && b < nc; b++)
+		power += BinPower(spectrum,b,length);
+	return power;
+}
+
+// Finds up to multiToneCount tones in the spectra of every channel and measures the phase skew of each channel
+// against the first one at every tone. A tone is a local maximum of the weakest channel's power that stands at least
+// multiToneThresholdDb above the noise floor and no more than multiToneMinLevelDb below the strongest bin. Only the
+// strongest tones are kept, in a min-heap, so the spectrum is scanned once and never sorted. The tones are stored in
+// detectedTones in order of frequency.
+void DetectTones(DFTComplex **spectra, int numChannels, int length, double binPrecision)
+{
+	int nc = (length/2)+1;
+	int maxTones = multiToneCount < MAX_TONES ? multiToneCount : MAX_TONES;
+	double *power = toneDetector.power;
+
+	// Power of the weakest channel in every bin
+	double strongest = 0;
+	for (int b = 0; b < nc; b++)
+	{
+		power[b] = BinPower(spectra[0],b,length);
+		for (int c = 1; c < numChannels; c++)
+		{
+			double channelPower = BinPower(spectra[c],b,length);
+			if (channelPower < power[b])
+				power[b] = channelPower;
+		}
+		toneDetector.scratch[b] = power[b];
+		if (power[b] > strongest)
+			strongest = power[b];
+	}
+
+	// Most bins hold no tone, so the median power is the noise floor
+	double threshold = SelectKth(toneDetector.scratch,nc,nc/2) * pow(10,multiToneThresholdDb/10);
+	if (threshold < strongest * pow(10,multiToneMinLevelDb/10))
+		threshold = strongest * pow(10,multiToneMinLevelDb/10);
+
+	// Keep the strongest local maxima above the threshold. The weakest tone kept is at the top of the heap
+	// and is replaced whenever a stronger one is found.
+	int heap[MAX_TONES];
+	int count = 0;
+	for (int b = 1; b < nc - 1; b++)
+	{
+		if (power[b] <= threshold || power[b] <= power[b-1] || power[b] < power[b+1])
+			continue;
+
+		int i;
+		if (count < maxTones)
+		{
+			// Add the tone and sift it up
+			for (i = count++; i > 0 && power[heap[(i-1)/2]] > power[b]; i = (i-1)/2)
+				heap[i] = heap[(i-1)/2];
+		}
+		else if (count > 0 && power[b] > power[heap[0]])
+		{
+			// Replace the weakest tone and sift the new one down
+			for (i = 0; 2*i + 1 < count; )
+			{
+				int child = 2*i + 1;
+				if (child + 1 < count && power[heap[child+1]] < power[heap[child]])
+					child++;
+				if (power[heap[child]] >= power[b])
+					break;
+				heap[i] = heap[child];
+				i = child;
+			}
+		}
+		else
+			continue;
+		heap[i] = b;
+	}
+
+	// Order the few tones kept by frequency
+	for (int t = 1; t < count; t++)
+	{
+		int bin = heap[t], i;
+		for (i = t; i > 0 && heap[i-1] > bin; i--)
+			heap[i] = heap[i-1];
+		heap[i] = bin;
+	}
+
+	// Measure the amplitude of every channel and its phase skew against the first channel at each tone
+	for (int t = 0; t < count; t++)
+	{
+		Tone *tone = &detectedTones[t];
+		int b = heap[t];
+		double dsaPhase = atan2(spectra[0][b][IMAG],spectra[0][b][REAL]) * (180/PI);
+		tone->bin = b;
+		tone->freq = b * binPrecision;
+		for (int c = 0; c < numChannels; c++)
+		{
+			double phase = atan2(spectra[c][b][IMAG],spectra[c][b][REAL]) * (180/PI);
+			tone->amplitude[c] = sqrt((spectra[c][b][REAL]*spectra[c][b][REAL]) + (spectra[c][b][IMAG]*spectra[c][b][IMAG])) * 2 / (length * dftWindowCoherentGain);
+			tone->skewDeg[c] = NormalizePhaseAngleDifference(dsaPhase-phase);
+			tone->skewSec[c] = (tone->skewDeg[c]/360) * (1/tone->freq);
+		}
+	}
+	numDetectedTones = count;
+}
+
+// Returns the k-th smallest of count values with quickselect, which only partitions the side that holds it.
+// Reorders the values.
+double SelectKth(double *values, int count, int k)
+{
+	int left = 0, right = count - 1;
+	while (left < right)
+	{
+		// Partition around the median of the first, middle and last values
+		int middle = left + (right - left) / 2;
+		double a = values[left], b = values[middle], c = values[right];
+		double pivot = a < b ? (b < c ? b : (a < c ? c : a)) : (a < c ? a : (b < c ? c : b));
+		int i = left, j = right;
+		while (i <= j)
+		{
+			while (values[i] < pivot)
+				i++;
+			while (values[j] > pivot)
+				j--;
+			if (i <= j)
+			{
+				double swap = values[i];
+				values[i++] = values[j];
+				values[j--] = swap;
+			}
+		}
+		if (k <= j)
+			right = j;
+		else if (k >= i)
+			left = i;
+		else
+			break;
+	}
+	return values[k];
+}
+
+// Sizes the zoom FFT for blocks of the given length. The band is decimated to 4*zoomSpanBins bins, so the FFT has
+// 4*(zoomPoints-1) points whatever the block length. fftLength is left at 0 if the block or the FFT is too short.
+void SizeZoomFFT(int length)
+{
+	double decimation = (double)length / (4 * zoomSpanBins);
+	zoomFFTState.length = length;
+	zoomFFTState.binStep = (double)zoomSpanBins / (zoomPoints - 1);
+	zoomFFTState.decimatedLength = (int)((length - 1) / decimation) + 2;
+	zoomFFTState.fftLength = decimation < 1 || zoomFFTState.decimatedLength > 4 * (zoomPoints - 1) ? 0 : 4 * (zoomPoints - 1);
+}
+
+// Precomputes the mixing table, decimation weights and filter gains used by ZoomTone() in the buffers carved by
+// CarveAnalysisBuffers(). Must be called after InitAcquisitionArena().
+void InitZoomFFT(void)
+{
+	int length = zoomFFTState.length;
+	int fftLength = zoomFFTState.fftLength;
+	int decimatedLength = zoomFFTState.decimatedLength;
+	double decimation = (double)length / (4 * zoomSpanBins);
+	if (fftLength == 0)
+	{
+		printf("Zoom FFT disabled: zoomPoints must be at least zoomSpanBins+2 and sampsPerChan at least 4*zoomSpanBins\n");
+		return;
+	}
+
+	for (int m = 0; m < length; m++)
+	{
+		zoomFFTState.twiddleRe[m] = cos(2 * PI * m / length);
+		zoomFFTState.twiddleIm[m] = -sin(2 * PI * m / length);
+	}
+
+	// Sample n lies between decimated samples m and m+1, m being the segment it is in. It is split between them with
+	// cos^2 and sin^2 of how far it lies past m, so every sample is counted once in total and the low-pass filter
+	// has nulls at every multiple of the decimated sample rate, where the aliases of the band come from.
+	for (int m = 0; m < decimatedLength - 1; m++)
+		zoomFFTState.segmentStart[m] = (int)ceil(m * decimation);
+	zoomFFTState.segmentStart[decimatedLength - 1] = length;
+	for (int m = 0; m < decimatedLength - 1; m++)
+	{
+		for (int n = zoomFFTState.segmentStart[m]; n < zoomFFTState.segmentStart[m+1]; n++)
+		{
+			double offset = (n - m * decimation) / decimation;
+			zoomFFTState.weight[n] = cos(PI * offset / 2) * cos(PI * offset / 2);
+		}
+	}
+
+	// The filter droops across the band, which would pull the strongest frequency towards the peak bin. The gain
+	// at every evaluated frequency is measured by decimating a tone at that frequency, and divided out of the band.
+	int firstPoint = -(zoomPoints - 1) / 2;
+	for (int k = 0; k < zoomPoints; k++)
+	{
+		double offset = (firstPoint + k) * zoomFFTState.binStep;
+		double sumRe = 0, sumIm = 0;
+		for (int m = 0; m < decimatedLength; m++)
+		{
+			double decimatedRe = 0, decimatedIm = 0;
+			int first = m > 0 ? zoomFFTState.segmentStart[m-1] : 0;
+			int last = m < decimatedLength - 1 ? zoomFFTState.segmentStart[m+1] : length;
+			for (int n = first; n < last; n++)
+			{
+				double share = n < zoomFFTState.segmentStart[m] ? 1 - zoomFFTState.weight[n] : zoomFFTState.weight[n];
+				decimatedRe += share * cos(2 * PI * offset * n / length);
+				decimatedIm += share * sin(2 * PI * offset * n / length);
+			}
+			double angle = -2 * PI * (firstPoint + k) * m / fftLength;
+			sumRe += (decimatedRe * cos(angle)) - (decimatedIm * sin(angle));
+			sumIm += (decimatedRe * sin(angle)) + (decimatedIm * cos(angle));
+		}
+		zoomFFTState.gain[k] = sqrt((sumRe * sumRe) + (sumIm * sumIm)) / length;
+	}
+
+	printf("Zoom FFT: %d points across %d bins, %1.3f bin resolution from %d decimated samples and a %d point FFT (a DFT of the same resolution needs %d points)\n",
+		zoomPoints,zoomSpanBins,zoomFFTState.binStep,decimatedLength,fftLength,(int)ceil(length / zoomFFTState.binStep));
+}
+
+// Evaluates zoomPoints frequencies spanning zoomSpanBins bins centred on peakBin for every channel, and returns the
+// frequency at which the weakest channel is strongest and the phase of every channel there. channels[c] points to
+// the length contiguous samples of channel c. The DFT window, if any, is applied to the samples first. Each channel
+// is mixed down so the peak bin is at 0 Hz, low-pass filtered and decimated, and the decimated samples are zero
+// padded and transformed with the plan created at startup. Returns 0, leaving freq and phaseDeg unchanged, if
+// InitZoomFFT() disabled the zoom or the DFT plan cache had no plan.
+int ZoomTone(double **channels, int numChannels, int peakBin, double binPrecision, double *freq, double *phaseDeg)
+{
+	int length = zoomFFTState.length;
+	int fftLength = zoomFFTState.fftLength;
+	int firstPoint = -(zoomPoints - 1) / 2; // FFT bin of the lowest evaluated frequency, relative to the peak bin
+	DFTReal *re = zoomFFTState.input[0], *im = zoomFFTState.input[1];
+	if (fftLength == 0)
+		return 0;
+
+	DFTPlan plan = GetDFTPlan(fftLength,1,0,re,zoomFFTState.spectrum[0]);
+	if (plan == NULL)
+		return 0;
+	for (int c = 0; c < numChannels; c++)
+	{
+		// Mix the peak bin down to 0 Hz and split every sample between the two decimated samples around it. The
+		// mixing phasor is read from the twiddle table since the peak is a whole number of bins.
+		for (int m = 0; m < fftLength; m++)
+			re[m] = im[m] = 0;
+		int step = ((peakBin % length) + length) % length;
+		int index = 0;
+		for (int m = 0; m < zoomFFTState.decimatedLength - 1; m++)
+		{
+			for (int n = zoomFFTState.segmentStart[m]; n < zoomFFTState.segmentStart[m+1]; n++)
+			{
+				DFTReal sample = dftWindow != NULL ? channels[c][n] * dftWindow[n] : channels[c][n];
+				DFTReal mixedRe = sample * zoomFFTState.twiddleRe[index], mixedIm = sample * zoomFFTState.twiddleIm[index];
+				DFTReal weight = zoomFFTState.weight[n];
+				re[m] += weight * mixedRe;
+				im[m] += weight * mixedIm;
+				re[m+1] += (1 - weight) * mixedRe;
+				im[m+1] += (1 - weight) * mixedIm;
+				index += step;
+				if (index >= length)
+					index -= length;
+			}
+		}
+
+		// The FFT of the complex decimated samples is assembled from the real DFTs of their real and imaginary parts,
+		// using the symmetry of a real DFT for the negative frequencies
+		ExecuteDFT(plan,re,zoomFFTState.spectrum[0]);
+		ExecuteDFT(plan,im,zoomFFTState.spectrum[1]);
+		DFTComplex *band = zoomFFTState.band + c*zoomPoints;
+		for (int k = 0; k < zoomPoints; k++)
+		{
+			int bin = firstPoint + k;
+			DFTComplex *a = &zoomFFTState.spectrum[0][bin >= 0 ? bin : -bin];
+			DFTComplex *b = &zoomFFTState.spectrum[1][bin >= 0 ? bin : -bin];
+			double sign = bin >= 0 ? 1 : -1;
+			band[k][REAL] = ((*a)[REAL] - (sign * (*b)[IMAG])) / zoomFFTState.gain[k];
+			band[k][IMAG] = ((sign * (*a)[IMAG]) + (*b)[REAL]) / zoomFFTState.gain[k];
+		}
+	}
+
+	// Find the frequency at which the weakest channel is strongest
+	int peak = 0;
+	double peakPower = -1;
+	for (int k = 0; k < zoomPoints; k++)
+	{
+		double weakest = 0;
+		for (int c = 0; c < numChannels; c++)
+		{
+			DFTComplex *point = &zoomFFTState.band[c*zoomPoints + k];
+			double power = ((*point)[REAL]*(*point)[REAL]) + ((*point)[IMAG]*(*point)[IMAG]);
+			if (c == 0 || power < weakest)
+				weakest = power;
+		}
+		if (weakest > peakPower)
+		{
+			peakPower = weakest;
+			peak = k;
+		}
+	}
+
+	*freq = (peakBin + (firstPoint + peak) * zoomFFTState.binStep) * binPrecision;
+	for (int c = 0; c < numChannels; c++)
+	{
+		DFTComplex *point = &zoomFFTState.band[c*zoomPoints + peak];
+		phaseDeg[c] = atan2((*point)[IMAG],(*point)[REAL]) * (180/PI);
+	}
+	return 1;
+}
+
+// Fills the STFT window and opens the spectrogram and index files. Must be called after InitAcquisitionArena().
+void InitSpectrogram(int length, int numChannels, double sampleRate)
+{
+	int bins = (stftLength/2)+1;
+	double sum = 0;
+	for (int i = 0; i < stftLength; i++)
+	{
+		spectrogramState.window[i] = WindowValue(stftWindowType,i,stftLength);
+		sum += spectrogramState.window[i];
+	}
+	spectrogramState.amplitudeScale = 2 / sum;
+	spectrogramState.historyLength = stftLength + length;
+	spectrogramState.frameBytes = (size_t)numChannels * bins * (spectrogramFormat == SPECTROGRAM_DB8 ? sizeof(uint8_t) : sizeof(float));
+
+	spectrogramState.file = fopen(spectrogramFileName, "wb");
+	spectrogramState.indexFile = fopen(spectrogramIndexFileName, "wb");
+	if (spectrogramState.file == NULL || spectrogramState.indexFile == NULL)
+	{
+		printf("Unable to create %s or %s, the spectrogram is not written\n",spectrogramFileName,spectrogramIndexFileName);
+		return;
+	}
+	setvbuf(spectrogramState.file,spectrogramState.fileBuffer,_IOFBF,spectrogramBufferBytes);
+
+	SpectrogramHeader header = {{'S','T','F','T'}, 1, numChannels, stftLength, stftHop, bins, spectrogramFormat, 0, sampleRate, spectrogramMinDb, spectrogramMaxDb};
+	fwrite(&header,sizeof(header),1,spectrogramState.file);
+}
+
+// Appends every frame the new block completes to the spectrogram. channels[c] points to the length samples of
+// channel c. Frames start every stftHop samples and may span blocks, so the samples a later frame still needs are
+// kept in the history.
+void SpectrogramBlock(double **channels, int numChannels, int length)
+{
+	if (spectrogramState.file == NULL)
+		return;
+
+	DFTPlan plan = GetDFTPlan(stftLength,1,0,spectrogramState.frame,spectrogramState.spectrum);
+	int bins = (stftLength/2)+1;
+	int available = spectrogramState.held + length;
+	int frame = spectrogramState.nextFrame;
+	for (int c = 0; c < numChannels; c++)
+		memcpy(spectrogramState.history + c*spectrogramState.historyLength + spectrogramState.held,channels[c],sizeof(double) * length);
+
+	for (; frame + stftLength <= available; frame += stftHop)
+	{
+		// Without a plan the frames are skipped, but the samples are still consumed
+		if (plan == NULL)
+			continue;
+
+		// Index the frame before it is written so the offset points at it
+		if (spectrogramState.frames % spectrogramIndexInterval == 0)
+		{
+			struct timespec now;
+			clock_gettime(CLOCK_REALTIME,&now);
+			SpectrogramIndexEntry entry = {spectrogramState.frames, spectrogramState.firstSample + frame,
+				sizeof(SpectrogramHeader) + spectrogramState.frames * spectrogramState.frameBytes, now.tv_sec + now.tv_nsec / 1e9};
+			fwrite(&entry,sizeof(entry),1,spectrogramState.indexFile);
+		}
+
+		// Window and transform the frame of every channel, and convert the bins to the file format
+		for (int c = 0; c < numChannels; c++)
+		{
+			double *samples = spectrogramState.history + c*spectrogramState.historyLength + frame;
+			StoreData(stftLength,1,samples,spectrogramState.window,spectrogramState.frame);
+			ExecuteDFT(plan,spectrogramState.frame,spectrogramState.spectrum);
+			for (int b = 0; b < bins; b++)
+			{
+				double amplitude = BinMagnitude(spectrogramState.spectrum[b]) * spectrogramState.amplitudeScale;
+				if (spectrogramFormat == SPECTROGRAM_DB8)
+				{
+					double level = (20 * log10(amplitude + 1e-300) - spectrogramMinDb) / (spectrogramMaxDb - spectrogramMinDb);
+					((uint8_t*)spectrogramState.row)[c*bins+b] = (uint8_t)(level <= 0 ? 0 : level >= 1 ? 255 : round(level * 255));
+				}
+				else
+					((float*)spectrogramState.row)[c*bins+b] = (float)amplitude;
+			}
+		}
+		fwrite(spectrogramState.row,spectrogramState.frameBytes,1,spectrogramState.file);
+		spectrogramState.frames++;
+	}
+
+	// Keep only the samples from the start of the next frame on
+	int discard = frame < available ? frame : available;
+	for (int c = 0; c < numChannels; c++)
+	{
+		double *history = spectrogramState.history + c*spectrogramState.historyLength;
+		memmove(history,history + discard,sizeof(double) * (available - discard));
+	}
+	spectrogramState.held = available - discard;
+	spectrogramState.nextFrame = frame - discard;
+	spectrogramState.firstSample += discard;
+}
+
+// Flushes and closes the spectrogram and index files. The buffers are freed with the arena, and the file is flushed
+// through the stdio buffer carved from it, so this must be called before DestroyAcquisitionArena().
+void DestroySpectrogram(void)
+{
+	if (spectrogramState.file != NULL)
+	{
+		printf("Spectrogram: %lld frame(s), %lld bytes\n",spectrogramState.frames,(long long)(sizeof(SpectrogramHeader) + spectrogramState.frames * spectrogramState.frameBytes));
+		fclose(spectrogramState.file);
+	}
+	if (spectrogramState.indexFile != NULL)
+		fclose(spectrogramState.indexFile);
+}
+
+// Returns the name of a DFT backend
+const char *DFTBackendName(int backend)
+{
+	return backend == DFT_BACKEND_BUILTIN ? "built-in" : "FFTW";
+}
+
+// Executes a real-to-complex plan from the DFT plan cache on the given buffers with the backend selected for it.
+// The built-in FFT transforms the channels of a batched plan one after the other.
+void ExecuteDFT(DFTPlan plan, DFTReal *real, DFTComplex *complex)
+{
+	if (plan->backend == DFT_BACKEND_BUILTIN)
+	{
+		for (int c = 0; c < plan->channels; c++)
+			BuiltinRealFFT(plan->builtinFFT,dftWorkSlot,real + c*plan->length,complex + c*((plan->length/2)+1));
+	}
+	else
+		FFTW(execute_dft_r2c)(plan->fftwPlan,real,complex);
+}
+
+// Executes a complex-to-real plan from the DFT plan cache. Like FFTW, the output is not divided by the length.
+void ExecuteInverseDFT(DFTPlan plan, DFTComplex *complex, DFTReal *real)
+{
+	if (plan->backend == DFT_BACKEND_BUILTIN)
+	{
+		for (int c = 0; c < plan->channels; c++)
+			BuiltinInverseRealFFT(plan->builtinFFT,dftWorkSlot,complex + c*((plan->length/2)+1),real + c*plan->length);
+	}
+	else
+		FFTW(execute_dft_c2r)(plan->fftwPlan,complex,real);
+}
+
+// Times both backends on a new plan, using the scratch buffers it was planned on, and selects the faster one
+void SelectDFTBackend(DFTPlan plan, DFTReal *real, DFTComplex *complex)
+{
+	plan->fftwMs = TimeDFTBackend(plan,DFT_BACKEND_FFTW,real,complex);
+	plan->builtinMs = TimeDFTBackend(plan,DFT_BACKEND_BUILTIN,real,complex);
+	plan->backend = plan->builtinMs < plan->fftwMs ? DFT_BACKEND_BUILTIN : DFT_BACKEND_FFTW;
+}
+
+// Returns the time, in ms, one execution of a plan takes with the given backend. The time is
+// the average over at least dftBackendBenchmarkSec, and includes loading a test signal.
+double TimeDFTBackend(DFTPlan plan, int backend, DFTReal *real, DFTComplex *complex)
+{
+	int values = (plan->inverse ? 2 * ((plan->length/2)+1) : plan->length) * plan->channels;
+	DFTReal *input = plan->inverse ? (DFTReal*)complex : real;
+	struct timespec start, end;
+	double elapsed = 0;
+	int runs = 0;
+	plan->backend = backend;
+	clock_gettime(CLOCK_MONOTONIC,&start);
+	while (elapsed < dftBackendBenchmarkSec || runs < 3)
+	{
+		// Reload the input every run, since a DFT may overwrite it
+		for (int i = 0; i < values; i++)
+			input[i] = (DFTReal)(i % 7) - 3;
+		if (plan->inverse)
+			ExecuteInverseDFT(plan,complex,real);
+		else
+			ExecuteDFT(plan,real,complex);
+		runs++;
+		clock_gettime(CLOCK_MONOTONIC,&end);
+		elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+	}
+	return 1000 * elapsed / runs;
+}
+
+// Prints the backend that executes each cached plan, and the times of both backends where they were compared
+void ReportDFTBackends(void)
+{
+	for (int i = 0; i < dftPlanCache.count; i++)
+	{
+		DFTPlanCacheEntry *entry = &dftPlanCache.entries[i];
+		printf("DFT backend for %d samples x %d channel(s)%s: %s",entry->length,entry->channels,entry->inverse ? " (inverse)" : "",DFTBackendName(entry->backend));
+		if (entry->fftwMs > 0 && entry->builtinMs > 0)
+			printf(" (FFTW %1.4f ms, built-in %1.4f ms)",entry->fftwMs,entry->builtinMs);
+		printf("\n");
+	}
+}
+
+// Factors the complex FFT of a real sequence of the given length into stages: radix 4 stages first, then radix 2,
+// then the odd factors from the smallest up, which are all prime
+void FactorBuiltinFFT(BuiltinFFT *fft, int length)
+{
+	fft->length = length;
+	fft->complexLength = length % 2 == 0 ? length/2 : length;
+	fft->stages = 0;
+	int remaining = fft->complexLength;
+	while (remaining > 1)
+	{
+		int radix = remaining % 4 == 0 ? 4 : remaining % 2 == 0 ? 2 : 3;
+		while (remaining % radix != 0)
+			radix += 2;
+		fft->radix[fft->stages++] = radix;
+		remaining /= radix;
+	}
+}
+
+// Carves a built-in FFT of the given length, its twiddle tables and its work buffers out of the arena, unless one of
+// that length is already carved. Work buffers are only carved for the threads that are started: the callback or
+// analysis thread, the channel DFT worker and the analysis workers. The others stay NULL.
+// Without an allocated block it only adds up the sizes.
+void CarveBuiltinFFT(int length)
+{
+	for (int i = 0; i < dftPlanCache.builtinFFTCount; i++)
+	{
+		if (dftPlanCache.builtinFFTLengths[i] == length)
+			return;
+	}
+	if (dftPlanCache.builtinFFTCount == DFT_PLAN_CACHE_SIZE)
+		return;
+
+	BuiltinFFT layout = {0};
+	FactorBuiltinFFT(&layout,length);
+	BuiltinFFT *fft = (BuiltinFFT*)ArenaAlloc(sizeof(BuiltinFFT));
+	int n = layout.complexLength;
+	for (int t = 0; t < layout.stages; t++)
+	{
+		int p = layout.radix[t], m = n / p;
+		layout.twiddleRe[t] = (DFTReal*)ArenaAlloc(sizeof(DFTReal) * (p-1) * m);
+		layout.twiddleIm[t] = (DFTReal*)ArenaAlloc(sizeof(DFTReal) * (p-1) * m);
+		layout.rootRe[t] = (DFTReal*)ArenaAlloc(sizeof(DFTReal) * p);
+		layout.rootIm[t] = (DFTReal*)ArenaAlloc(sizeof(DFTReal) * p);
+		n = m;
+	}
+	if (length % 2 == 0)
+	{
+		layout.splitRe = (DFTReal*)ArenaAlloc(sizeof(DFTReal) * ((length/2)+1));
+		layout.splitIm = (DFTReal*)ArenaAlloc(sizeof(DFTReal) * ((length/2)+1));
+	}
+	for (int slot = 0; slot < 2 + AnalysisWorkerCount(); slot++)
+	{
+		if (slot == 1 && !channelDFTWorker.running)
+			continue;
+		for (int b = 0; b < 2; b++)
+		{
+			layout.workRe[slot][b] = (DFTReal*)ArenaAlloc(sizeof(DFTReal) * layout.complexLength);
+			layout.workIm[slot][b] = (DFTReal*)ArenaAlloc(sizeof(DFTReal) * layout.complexLength);
+		}
+	}
+	if (fft != NULL)
+		*fft = layout;
+	dftPlanCache.builtinFFTs[dftPlanCache.builtinFFTCount] = fft;
+	dftPlanCache.builtinFFTLengths[dftPlanCache.builtinFFTCount++] = length;
+}
+
+// Returns the built-in FFT of a real sequence of the given length carved by CarveBuiltinFFT(), with its twiddle factors
+// tabulated on the first call, or NULL if none was carved for that length
+BuiltinFFT *CreateBuiltinFFT(int length)
+{
+	const double twoPi = 2 * acos(-1.0); // Full precision. PI is only accurate to 9 digits.
+	BuiltinFFT *fft = NULL;
+	for (int i = 0; i < dftPlanCache.builtinFFTCount; i++)
+	{
+		if (dftPlanCache.builtinFFTLengths[i] == length)
+			fft = dftPlanCache.builtinFFTs[i];
+	}
+	if (fft == NULL || fft->tabulated)
+		return fft;
+
+	// Each stage transforms n elements as radix sequences of m = n/radix elements, and the next stage transforms those
+	int n = fft->complexLength;
+	for (int t = 0; t < fft->stages; t++)
+	{
+		int p = fft->radix[t], m = n / p;
+		for (int k = 1; k < p; k++)
+		{
+			for (int j = 0; j < m; j++)
+			{
+				double angle = -twoPi * (((long long)j * k) % n) / n;
+				fft->twiddleRe[t][(k-1)*m + j] = cos(angle);
+				fft->twiddleIm[t][(k-1)*m + j] = sin(angle);
+			}
+		}
+		for (int k = 0; k < p; k++)
+		{
+			fft->rootRe[t][k] = cos(-twoPi * k / p);
+			fft->rootIm[t][k] = sin(-twoPi * k / p);
+		}
+		n = m;
+	}
+
+	if (length % 2 == 0)
+	{
+		for (int k = 0; k <= length/2; k++)
+		{
+			fft->splitRe[k] = cos(-twoPi * k / length);
+			fft->splitIm[k] = sin(-twoPi * k / length);
+		}
+	}
+	fft->tabulated = 1;
+	return fft;
+}
+
+// Calculates the real-to-complex DFT of real into the length/2+1 bins of complex with the work buffers of the given slot.
+// The output may overwrite the input.
+void BuiltinRealFFT(BuiltinFFT *fft, int slot, DFTReal *real, DFTComplex *complex)
+{
+	int n = fft->complexLength;
+	DFTReal *zr = fft->workRe[slot][0], *zi = fft->workIm[slot][0];
+
+	// An even length is packed as a complex sequence of half the length: even samples in the real parts, odd ones in the imaginary parts
+	if (fft->length % 2 == 0)
+	{
+		for (int i = 0; i < n; i++)
+		{
+			zr[i] = real[2*i];
+			zi[i] = real[2*i+1];
+		}
+	}
+	else
+	{
+		for (int i = 0; i < n; i++)
+		{
+			zr[i] = real[i];
+			zi[i] = 0;
+		}
+	}
+	int result = BuiltinComplexFFT(fft,slot);
+	zr = fft->workRe[slot][result];
+	zi = fft->workIm[slot][result];
+
+	if (fft->length % 2 != 0)
+	{
+		for (int k = 0; k <= n/2; k++)
+		{
+			complex[k][0] = zr[k];
+			complex[k][1] = zi[k];
+		}
+		return;
+	}
+
+	// Split Z, the FFT of the packed sequence, into E and O, the FFTs of the even and odd samples, and combine them:
+	// X[k] = E[k] + W^k O[k], with E[k] = (Z[k] + conj(Z[n-k]))/2 and O[k] = (Z[k] - conj(Z[n-k]))/2j
+	for (int k = 0; k <= n; k++)
+	{
+		int a = k == n ? 0 : k;
+		int b = k == 0 ? 0 : n - k;
+		DFTReal er = (zr[a] + zr[b]) * (DFTReal)0.5, ei = (zi[a] - zi[b]) * (DFTReal)0.5;
+		DFTReal odr = (zi[a] + zi[b]) * (DFTReal)0.5, odi = (zr[b] - zr[a]) * (DFTReal)0.5;
+		complex[k][0] = er + fft->splitRe[k] * odr - fft->splitIm[k] * odi;
+		complex[k][1] = ei + fft->splitRe[k] * odi + fft->splitIm[k] * odr;
+	}
+}
+
+// Calculates the complex-to-real DFT of the length/2+1 bins of complex into real with the work buffers of the given slot,
+// without dividing by the length. The output may overwrite the input.
+void BuiltinInverseRealFFT(BuiltinFFT *fft, int slot, DFTComplex *complex, DFTReal *real)
+{
+	int n = fft->complexLength;
+	DFTReal *zr = fft->workRe[slot][0], *zi = fft->workIm[slot][0];
+
+	// The inverse is calculated with the forward FFT of the conjugate. An even length recombines E and O into the packed sequence, Z[k] = E[k] + j O[k].
+	if (fft->length % 2 == 0)
+	{
+		for (int k = 0; k < n; k++)
+		{
+			int b = n - k;
+			DFTReal er = complex[k][0] + complex[b][0], ei = complex[k][1] - complex[b][1];
+			DFTReal dr = complex[k][0] - complex[b][0], di = complex[k][1] + complex[b][1];
+			DFTReal odr = dr * fft->splitRe[k] + di * fft->splitIm[k], odi = di * fft->splitRe[k] - dr * fft->splitIm[k];
+			zr[k] = er - odi;
+			zi[k] = -(ei + odr);
+		}
+	}
+	else
+	{
+		for (int k = 0; k <= n/2; k++)
+		{
+			zr[k] = complex[k][0];
+			zi[k] = -complex[k][1];
+		}
+		for (int k = n/2 + 1; k < n; k++)
+		{
+			zr[k] = complex[n-k][0];
+			zi[k] = complex[n-k][1];
+		}
+	}
+	int result = BuiltinComplexFFT(fft,slot);
+	zr = fft->workRe[slot][result];
+	zi = fft->workIm[slot][result];
+
+	if (fft->length % 2 == 0)
+	{
+		for (int i = 0; i < n; i++)
+		{
+			real[2*i] = zr[i];
+			real[2*i+1] = -zi[i];
+		}
+	}
+	else
+	{
+		for (int i = 0; i < n; i++)
+			real[i] = zr[i];
+	}
+}
+
+// Calculates the forward complex FFT of the first work buffers of the given slot, one stage at a time between the
+// ping-pong buffers, and returns which of the two holds the result
+int BuiltinComplexFFT(BuiltinFFT *fft, int slot)
+{
+	int n = fft->complexLength, s = 1, in = 0;
+	for (int t = 0; t < fft->stages; t++)
+	{
+		int p = fft->radix[t], m = n / p;
+		DFTReal *xr = fft->workRe[slot][in], *xi = fft->workIm[slot][in];
+		DFTReal *yr = fft->workRe[slot][1-in], *yi = fft->workIm[slot][1-in];
+		if (p == 4)
+			BuiltinRadix4(s,m,fft->twiddleRe[t],fft->twiddleIm[t],xr,xi,yr,yi);
+		else if (p == 2)
+			BuiltinRadix2(s,m,fft->twiddleRe[t],fft->twiddleIm[t],xr,xi,yr,yi);
+		else
+			BuiltinRadixGeneric(p,s,m,fft->twiddleRe[t],fft->twiddleIm[t],fft->rootRe[t],fft->rootIm[t],xr,xi,yr,yi);
+		in = 1 - in;
+		n = m;
+		s *= p;
+	}
+	return in;
+}
+
+// One radix 2 stage: s interleaved sequences of 2m elements, element j+r*m of sequence q at x[q + s*(j + r*m)],
+// are each split into 2 sequences of m elements stored at y[q + s*(2*j + k)]
+void BuiltinRadix2(int s, int m, const DFTReal *twRe, const DFTReal *twIm, const DFTReal *restrict xr, const DFTReal *restrict xi, DFTReal *restrict yr, DFTReal *restrict yi)
+{
+	for (int j = 0; j < m; j++)
+	{
+		DFTReal wr = twRe[j], wi = twIm[j];
+		const DFTReal *ar = xr + s*j, *ai = xi + s*j, *br = xr + s*(j+m), *bi = xi + s*(j+m);
+		DFTReal *y0r = yr + s*2*j, *y0i = yi + s*2*j, *y1r = yr + s*(2*j+1), *y1i = yi + s*(2*j+1);
+		for (int q = 0; q < s; q++)
+		{
+			DFTReal dr = ar[q] - br[q], di = ai[q] - bi[q];
+			y0r[q] = ar[q] + br[q];
+			y0i[q] = ai[q] + bi[q];
+			y1r[q] = dr * wr - di * wi;
+			y1i[q] = dr * wi + di * wr;
+		}
+	}
+}
+
+// One radix 4 stage, laid out like a radix 2 stage
+void BuiltinRadix4(int s, int m, const DFTReal *twRe, const DFTReal *twIm, const DFTReal *restrict xr, const DFTReal *restrict xi, DFTReal *restrict yr, DFTReal *restrict yi)
+{
+	for (int j = 0; j < m; j++)
+	{
+		DFTReal w1r = twRe[j], w1i = twIm[j], w2r = twRe[m+j], w2i = twIm[m+j], w3r = twRe[2*m+j], w3i = twIm[2*m+j];
+		const DFTReal *a0r = xr + s*j, *a0i = xi + s*j, *a1r = xr + s*(j+m), *a1i = xi + s*(j+m);
+		const DFTReal *a2r = xr + s*(j+2*m), *a2i = xi + s*(j+2*m), *a3r = xr + s*(j+3*m), *a3i = xi + s*(j+3*m);
+		DFTReal *y0r = yr + s*4*j, *y0i = yi + s*4*j, *y1r = y0r + s, *y1i = y0i + s;
+		DFTReal *y2r = y0r + 2*s, *y2i = y0i + 2*s, *y3r = y0r + 3*s, *y3i = y0i + 3*s;
+		for (int q = 0; q < s; q++)
+		{
+			// t3 is (a1 - a3) multiplied by -j
+			DFTReal t0r = a0r[q] + a2r[q], t0i = a0i[q] + a2i[q];
+			DFTReal t1r = a0r[q] - a2r[q], t1i = a0i[q] - a2i[q];
+			DFTReal t2r = a1r[q] + a3r[q], t2i = a1i[q] + a3i[q];
+			DFTReal t3r = a1i[q] - a3i[q], t3i = a3r[q] - a1r[q];
+			DFTReal b1r = t1r + t3r, b1i = t1i + t3i;
+			DFTReal b2r = t0r - t2r, b2i = t0i - t2i;
+			DFTReal b3r = t1r - t3r, b3i = t1i - t3i;
+			y0r[q] = t0r + t2r;
+			y0i[q] = t0i + t2i;
+			y1r[q] = b1r * w1r - b1i * w1i;
+			y1i[q] = b1r * w1i + b1i * w1r;
+			y2r[q] = b2r * w2r - b2i * w2i;
+			y2i[q] = b2r * w2i + b2i * w2r;
+			y3r[q] = b3r * w3r - b3i * w3i;
+			y3i[q] = b3r * w3i + b3i * w3r;
+		}
+	}
+}
+
+// One stage of any radix p, laid out like a radix 2 stage. Each output is accumulated over the p inputs, so a stage takes
+// O(p) operations per element and long prime factors are slow; the backend self-benchmark then selects FFTW.
+void BuiltinRadixGeneric(int p, int s, int m, const DFTReal *twRe, const DFTReal *twIm, const DFTReal *rootRe, const DFTReal *rootIm,
+	const DFTReal *restrict xr, const DFTReal *restrict xi, DFTReal *restrict yr, DFTReal *restrict yi)
+{
+	for (int j = 0; j < m; j++)
+	{
+		for (int k = 0; k < p; k++)
+		{
+			DFTReal *ykr = yr + s*(p*j + k), *yki = yi + s*(p*j + k);
+			for (int q = 0; q < s; q++)
+			{
+				ykr[q] = 0;
+				yki[q] = 0;
+			}
+			for (int r = 0; r < p; r++)
+			{
+				DFTReal wr = rootRe[(r*k) % p], wi = rootIm[(r*k) % p];
+				const DFTReal *ar = xr + s*(j + r*m), *ai = xi + s*(j + r*m);
+				for (int q = 0; q < s; q++)
+				{
+					ykr[q] += ar[q] * wr - ai[q] * wi;
+					yki[q] += ar[q] * wi + ai[q] * wr;
+				}
+			}
+			if (k > 0)
+			{
+				DFTReal wr = twRe[(k-1)*m + j], wi = twIm[(k-1)*m + j];
+				for (int q = 0; q < s; q++)
+				{
+					DFTReal vr = ykr[q];
+					ykr[q] = vr * wr - yki[q] * wi;
+					yki[q] = vr * wi + yki[q] * wr;
+				}
+			}
+		}
+	}
+}
+
+// Carves the slots of the analysis ring and their sample and spectrum buffers. Channel c of a slot starts at
+// data[c*dataStride]. With padChannels every channel starts on a cache line, so one plan serves every channel;
+// otherwise the channels follow each other like the block DAQmx reads with DAQmx_Val_GroupByChannel.
+// Without an allocated block it only adds up their sizes.
+void CarveAnalysisRing(int length, int channels, int padChannels)
+{
+	int nc = (length/2)+1;
+	int workers = AnalysisWorkerCount();
+	if (!analysisThread)
+		return;
+
+	analysisRing.channels = channels;
+	analysisRing.dataStride = padChannels ? (length * sizeof(float64) + ARENA_ALIGNMENT - 1) / ARENA_ALIGNMENT * ARENA_ALIGNMENT / sizeof(float64) : length;
+	analysisRing.inputStride = padChannels ? (length * sizeof(DFTReal) + ARENA_ALIGNMENT - 1) / ARENA_ALIGNMENT * ARENA_ALIGNMENT / sizeof(DFTReal) : length;
+	analysisRing.outputStride = padChannels ? (nc * sizeof(DFTComplex) + ARENA_ALIGNMENT - 1) / ARENA_ALIGNMENT * ARENA_ALIGNMENT / sizeof(DFTComplex) : nc;
+	analysisRing.slots = (AnalysisRingSlot*)ArenaAlloc(sizeof(AnalysisRingSlot) * analysisRingSlots);
+
+	// Each buffer of a slot starts on a cache line, so every slot has the alignment the plans were created with
+	for (int i = 0; i < analysisRingSlots; i++)
+	{
+		AnalysisRingSlot slot = {0};
+		slot.data = (float64*)ArenaAlloc(sizeof(float64) * analysisRing.dataStride * channels);
+		if (rawReads)
+			slot.codes = (int32*)ArenaAlloc(sizeof(int32) * analysisRing.dataStride * channels);
+		if (workers > 0 && (DFT_SINGLE_PRECISION || dftWindow != NULL))
+			slot.input = (DFTReal*)ArenaAlloc(sizeof(DFTReal) * analysisRing.inputStride * channels);
+		if (workers > 0)
+			slot.output = (DFTComplex*)ArenaAlloc(sizeof(DFTComplex) * analysisRing.outputStride * channels);
+		if (analysisRing.slots != NULL)
+			analysisRing.slots[i] = slot;
+	}
+}
+
+// Starts the analysis thread, which analyses each block with analyze(), and the analysis workers, which calculate
+// the spectra of each block with transform() first. The slots must have been carved by CarveAnalysisRing().
+void InitAnalysisRing(void *callbackData, AnalyzeRingSlotFunction analyze, TransformRingSlotFunction transform)
+{
+	int workers = AnalysisWorkerCount();
+	analysisRing.analyze = analyze;
+	analysisRing.transform = transform;
+	sem_init(&analysisRing.ready,0,0);
+	pthread_create(&analysisRing.thread,NULL,AnalysisThread,callbackData);
+
+	// Start the workers that calculate the spectra ahead of the analysis thread
+	if (workers > 0)
+	{
+		sem_init(&analysisRing.pending,0,0);
+		for (int w = 0; w < workers; w++)
+			pthread_create(&analysisRing.workers[w],NULL,AnalysisWorkerThread,(void*)(intptr_t)w);
+	}
+}
+
+// Returns the slot the callback reads the next block into, or NULL if every slot is still waiting for the analysis thread
+AnalysisRingSlot *NextFreeRingSlot(void)
+{
+	unsigned int tail = __atomic_load_n(&analysisRing.tail,__ATOMIC_ACQUIRE);
+	if (analysisRing.head - tail == (unsigned int)analysisRingSlots)
+		return NULL;
+	return &analysisRing.slots[analysisRing.head % analysisRingSlots];
+}
+
+// Counts samples per channel of each task that were read but will not be analysed, such as those of a dropped block.
+// They are passed on with the next block delivered, so the totals still count them.
+void SkipSamples(const int32 *samples)
+{
+	for (int t = 0; t < MAX_TASKS; t++)
+		analysisRing.skipped[t] += samples[t];
+}
+
+// Moves the samples counted by SkipSamples() since the last call into skipped, one count per task
+void TakeSkippedSamples(int32 *skipped)
+{
+	for (int t = 0; t < MAX_TASKS; t++)
+	{
+		skipped[t] = analysisRing.skipped[t];
+		analysisRing.skipped[t] = 0;
+	}
+}
+
+// Hands the block read into a slot to the analysis thread. read holds the samples per channel read by each task.
+// If slot is NULL the block is counted as dropped, and its samples are passed on with the next published block
+// so the totals still count them.
+void PublishRingSlot(AnalysisRingSlot *slot, const int32 *read)
+{
+	if (slot == NULL)
+	{
+		analysisRing.dropped++;
+		SkipSamples(read);
+		return;
+	}
+	for (int t = 0; t < MAX_TASKS; t++)
+		slot->read[t] = read[t];
+	TakeSkippedSamples(slot->skipped);
+
+	// Count the blocks waiting, this one included, then publish the slot
+	unsigned int head = analysisRing.head + 1;
+	unsigned int occupancy = head - __atomic_load_n(&analysisRing.tail,__ATOMIC_ACQUIRE);
+	if (occupancy > analysisRing.highWater)
+		analysisRing.highWater = occupancy;
+	analysisRing.occupancySum += occupancy;
+	__atomic_store_n(&analysisRing.head,head,__ATOMIC_RELEASE);
+
+	// With analysis workers, the next free worker calculates the spectra first
+	sem_post(AnalysisWorkerCount() > 0 ? &analysisRing.pending : &analysisRing.ready);
+}
+
+// Analyses the blocks published to the ring in the order they were read. With analysis workers the slots are also the
+// reorder buffer: a block whose spectra are ready waits in its slot until every earlier block has been analysed.
+// Stops once DestroyAnalysisRing() wakes it with no block left.
+void *AnalysisThread(void *arg)
+{
+	// Keep this thread on the DFT cores if it calculates the DFTs itself. It only takes the spectra of the workers otherwise.
+	int workers = AnalysisWorkerCount();
+	if (workers == 0)
+		RestrictToDFTCores(pthread_self());
+	unsigned int tail = analysisRing.tail;
+	while (1)
+	{
+		sem_wait(&analysisRing.ready);
+		int stopping = __atomic_load_n(&analysisRing.stopping,__ATOMIC_ACQUIRE);
+		unsigned int head = __atomic_load_n(&analysisRing.head,__ATOMIC_ACQUIRE);
+
+		// Analyse every block that is ready, stopping at the first one a worker has not finished
+		while (tail != head)
+		{
+			AnalysisRingSlot *slot = &analysisRing.slots[tail % analysisRingSlots];
+			if (workers > 0 && !__atomic_load_n(&slot->transformed,__ATOMIC_ACQUIRE))
+				break;
+			analysisRing.analyze(arg,slot);
+			slot->transformed = 0;
+			__atomic_store_n(&analysisRing.tail,++tail,__ATOMIC_RELEASE);
+		}
+		if (stopping)
+			break;
+	}
+	return NULL;
+}
+
+// Calculates the spectra of the blocks published to the ring in parallel with the other workers, and hands each
+// block on to the analysis thread. Stops on one of the extra wake-ups DestroyAnalysisRing() posts.
+void *AnalysisWorkerThread(void *arg)
+{
+	// Use this worker's own work buffers of the built-in FFT, and keep it on the DFT cores
+	dftWorkSlot = 2 + (int)(intptr_t)arg;
+	RestrictToDFTCores(pthread_self());
+
+	while (1)
+	{
+		sem_wait(&analysisRing.pending);
+
+		// Blocks are taken in the order they were read. Every wake-up past the last published block is a stop.
+		unsigned int block = __atomic_fetch_add(&analysisRing.claimed,1,__ATOMIC_ACQ_REL);
+		if (block - __atomic_load_n(&analysisRing.head,__ATOMIC_ACQUIRE) < (unsigned int)MAX_ANALYSIS_WORKERS)
+			break;
+
+		AnalysisRingSlot *slot = &analysisRing.slots[block % analysisRingSlots];
+		analysisRing.transform(slot);
+		if (__atomic_fetch_add(&analysisRing.finished,1,__ATOMIC_RELAXED) != block)
+			__atomic_fetch_add(&analysisRing.reordered,1,__ATOMIC_RELAXED);
+		__atomic_store_n(&slot->transformed,1,__ATOMIC_RELEASE);
+		sem_post(&analysisRing.ready);
+	}
+	return NULL;
+}
+
+// Lets the analysis thread finish the blocks still in the ring and stops it. Must be called after the tasks are stopped.
+void DestroyAnalysisRing(void)
+{
+	if (analysisRing.analyze == NULL)
+		return;
+
+	// The workers finish the blocks they were handed, then each stops on one of the extra wake-ups
+	int workers = AnalysisWorkerCount();
+	for (int w = 0; w < workers; w++)
+		sem_post(&analysisRing.pending);
+	for (int w = 0; w < workers; w++)
+		pthread_join(analysisRing.workers[w],NULL);
+	if (workers > 0)
+		sem_destroy(&analysisRing.pending);
+
+	__atomic_store_n(&analysisRing.stopping,1,__ATOMIC_RELEASE);
+	sem_post(&analysisRing.ready);
+	pthread_join(analysisRing.thread,NULL);
+	sem_destroy(&analysisRing.ready);
+	analysisRing.analyze = NULL;
+}
+
+// Returns the number of analysis workers started, or 0 if the analysis thread calculates the DFTs itself
+int AnalysisWorkerCount(void)
+{
+	if (!analysisThread || analysisWorkers <= 1)
+		return 0;
+	return analysisWorkers < MAX_ANALYSIS_WORKERS ? analysisWorkers : MAX_ANALYSIS_WORKERS;
+}
+
+// Returns how many complete blocks a callback reads when available samples per channel are waiting in the DAQmx
+// buffer, at most maxCatchUpBlocks, and records the backlog
+int CatchUpBlocks(uInt32 available)
+{
+	int blocks = available / sampsPerChan;
+	catchUp.backlog = blocks;
+	catchUp.callbacks++;
+	catchUp.backlogSum += blocks;
+	if (blocks > catchUp.maxBacklog)
+		catchUp.maxBacklog = blocks;
+	if (blocks > maxCatchUpBlocks)
+	{
+		catchUp.leftBehind++;
+		blocks = maxCatchUpBlocks;
+	}
+	if (blocks > 1)
+	{
+		catchUp.batches++;
+		catchUp.batchedBlocks += blocks;
+	}
+	return blocks;
+}
+
+// Returns how many complete blocks every one of the numTasks tasks read in a catch-up read, read holding the samples per
+// channel each task returned. Only a short read, such as one that timed out, leaves a partial block behind. Its samples
+// are not analysed, and are counted as skipped so the totals still include them.
+int CompleteBatchBlocks(const int32 *read, int numTasks)
+{
+	int32 least = read[0];
+	for (int t = 1; t < numTasks; t++)
+		if (read[t] < least)
+			least = read[t];
+	int blocks = least / sampsPerChan;
+
+	int32 remainder[MAX_TASKS] = {0};
+	for (int t = 0; t < numTasks; t++)
+		remainder[t] = read[t] - blocks * sampsPerChan;
+	SkipSamples(remainder);
+	return blocks;
+}
+
+// Sets the DAQmx input buffer of each task to hold consumerStallBudgetSec of samples, within maxInputBufferMemoryFraction
+// of the available memory, and prints its size. Returns a DAQmx error code.
+int32 ConfigureInputBuffers(TaskHandle *tasks, int numTasks, int totalChannels)
+{
+	int32 error = 0;
+	uInt32 bufferSize;
+
+	// Raw samples take at most 4 bytes in the driver's buffer
+	double bytesPerSample = totalChannels * sizeof(int32);
+	double availableBytes = (double)sysconf(_SC_AVPHYS_PAGES) * sysconf(_SC_PAGESIZE);
+	if (sizeInputBuffer)
+	{
+		// Whole blocks covering the stall budget, and at least two so one can be read while the next is acquired
+		double blocks = ceil(sampleRate * consumerStallBudgetSec / sampsPerChan);
+		double maxBlocks = floor(availableBytes * maxInputBufferMemoryFraction / (bytesPerSample * sampsPerChan));
+		if (maxBlocks > UINT32_MAX / sampsPerChan)
+			maxBlocks = UINT32_MAX / sampsPerChan;
+		if (blocks > maxBlocks)
+		{
+			double neededMB = blocks * sampsPerChan * bytesPerSample / 1e6;
+			blocks = maxBlocks > 2 ? maxBlocks : 2;
+			printf("Warning: an input buffer for a %1.2f s stall needs %1.1f MB, more than %1.0f%% of the %1.1f MB of memory available, so it only covers %1.2f s\n",consumerStallBudgetSec,neededMB,maxInputBufferMemoryFraction * 100,availableBytes / 1e6,blocks * sampsPerChan / sampleRate);
+		}
+		else if (blocks < 2)
+			blocks = 2;
+		for (int t = 0; t < numTasks; t++)
+		{
+			error = DAQmxCfgInputBuffer(tasks[t],(uInt32)blocks * sampsPerChan);
+			if (error < 0)
+				return error;
+		}
+	}
+
+	// DAQmx may round the size, so the fill level is watched against the size it reports
+	error = DAQmxGetBufInputBufSize(tasks[0],&bufferSize);
+	if (error < 0)
+		return error;
+	inputBuffer.size = bufferSize;
+	inputBuffer.warnLevel = (uInt32)(bufferSize * bufferFillWarning);
+	printf("Input buffer (samples per channel): %u, %1.2f s of samples, %1.1f MB of %1.1f MB of memory available%s\n",(unsigned)bufferSize,bufferSize / sampleRate,bufferSize * bytesPerSample / 1e6,availableBytes / 1e6,sizeInputBuffer ? "" : " (DAQmx default)");
+	return error;
+}
+
+// Records how many samples per channel are waiting in the input buffer, and raises a warning once each time more than
+// bufferFillWarning of it fills. The warning is raised again after the fill level has fallen below half that. Called
+// from the DAQmx callback, so the warning is only flagged here and printed by ReportInputBufferWarning().
+void WatchInputBuffer(uInt32 available)
+{
+	if (available > inputBuffer.peakFill)
+		inputBuffer.peakFill = available;
+	if (bufferFillWarning <= 0 || inputBuffer.size == 0)
+		return;
+	if (!inputBuffer.warning && available > inputBuffer.warnLevel)
+	{
+		inputBuffer.warning = 1;
+		inputBuffer.warnings++;
+		__atomic_store_n(&inputBuffer.warnedFill,available,__ATOMIC_RELEASE);
+	}
+	else if (inputBuffer.warning && available < inputBuffer.warnLevel / 2)
+		inputBuffer.warning = 0;
+}
+
+// Prints the input buffer warning raised by WatchInputBuffer() since the last call, if any. Called by the analysis.
+void ReportInputBufferWarning(void)
+{
+	uInt32 fill = __atomic_exchange_n(&inputBuffer.warnedFill,0,__ATOMIC_ACQUIRE);
+	if (fill > 0)
+		printf("\nWarning: the DAQmx input buffer is %1.0f%% full (%u of %u samples per channel)\n",100.0 * fill / inputBuffer.size,(unsigned)fill,(unsigned)inputBuffer.size);
+}
+
+// Fetches the polynomial that scales the raw codes of a channel to volts and prints it. Returns a DAQmx error code.
+int32 InitRawScaling(TaskHandle task, const char *channel, RawScaling *scaling)
+{
+	// Called without an array, DAQmx returns the number of coefficients
+	int32 count = DAQmxGetAIDevScalingCoeff(task,channel,NULL,0);
+	if (count < 0)
+		return count;
+	scaling->numCoeffs = count < MAX_SCALING_COEFFS ? count : MAX_SCALING_COEFFS;
+	int32 error = DAQmxGetAIDevScalingCoeff(task,channel,scaling->coeffs,scaling->numCoeffs);
+	if (error >= 0)
+	{
+		printf("Raw reads of %s are scaled with",channel);
+		for (int k = 0; k < scaling->numCoeffs; k++)
+			printf(" c%d=%1.6e",k,scaling->coeffs[k]);
+		printf("\n");
+	}
+	return error;
+}
+
+// Scales length raw codes to volts with the polynomial of their channel. Uses AVX2 on x64 processors that support it.
+// ARM targets use the scalar kernel, which the compiler vectorises where it can, since ARMv7 NEON has no double precision.
+void ScaleRawCodes(const int32 *codes, const RawScaling *scaling, int length, float64 *volts)
+{
+#if SPECTRUM_AVX2
+	if (__builtin_cpu_supports("avx2"))
+	{
+		ScaleRawCodesAVX2(codes,scaling,length,volts);
+		return;
+	}
+#endif
+	ScaleRawCodesScalar(codes,scaling,0,length,volts);
+}
+
+// Scalar scaling kernel, which evaluates the polynomial by Horner's rule. Starts at first, so the vector kernel
+// can finish the codes left over at the end with it.
+void ScaleRawCodesScalar(const int32 *codes, const RawScaling *scaling, int first, int length, float64 *volts)
+{
+	const float64 *c = scaling->coeffs;
+	int last = scaling->numCoeffs - 1;
+	for (int i = first; i < length; i++)
+	{
+		float64 x = codes[i];
+		float64 v = c[last];
+		for (int k = last - 1; k >= 0; k--)
+			v = v*x + c[k];
+		volts[i] = v;
+	}
+}
+
+#if SPECTRUM_AVX2
+// AVX2 scaling kernel. Each iteration converts 4 codes to double and evaluates the polynomial on all of them at once.
+__attribute__((target("avx2")))
+void ScaleRawCodesAVX2(const int32 *codes, const RawScaling *scaling, int length, float64 *volts)
+{
+	__m256d c[MAX_SCALING_COEFFS];
+	int last = scaling->numCoeffs - 1;
+	for (int k = 0; k <= last; k++)
+		c[k] = _mm256_set1_pd(scaling->coeffs[k]);
+
+	int i = 0;
+	for (; i + 4 <= length; i += 4)
+	{
+		__m256d x = _mm256_cvtepi32_pd(_mm_loadu_si128((const __m128i*)(codes + i)));
+		__m256d v = c[last];
+		for (int k = last - 1; k >= 0; k--)
+			v = _mm256_add_pd(_mm256_mul_pd(v,x),c[k]);
+		_mm256_storeu_pd(volts + i,v);
+	}
+	ScaleRawCodesScalar(codes,scaling,i,length,volts);
+}
+#endif
+
+// Ensures the phase angle is between -180 deg and 180 deg
+double NormalizePhaseAngleDifference(double phase)
+{
+	if (phase > 270)
+		phase = phase - 360;
+	
+	if (phase < -90)
+		phase = phase + 360;
+
+	return phase;
+}
@@ -0,0 +1,598 @@
+/*********************************************************************
+*
+* SyncCommon.h
+*
+* Description:
+*    Types, options and functions shared by SmplClkSync, RefClkSync
+*    and ChnlExpSync: the DFT analysis, the DFT plan cache and
+*    backends, the acquisition arena, the analysis ring and the
+*    DAQmx input buffer helpers. Each program compiles SyncCommon.c
+*    and SyncOptions.c alongside its own source file (see
+*    build/CMakeLists.txt).
+*
+*********************************************************************/
+
+#ifndef SYNC_COMMON_H
+#define SYNC_COMMON_H
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <NIDAQmx.h>
+#include <math.h>
+#include <float.h>
+#include <fftw3.h>
+#include <time.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <unistd.h>
+
+#define REAL 0
+#define IMAG 1
+#define PI 3.14159265
+#define MAX_CHANNELS 64 // Maximum number of channels any of the programs analyses
+#define DFT_BIN_RESEED_SAMPLES 256 // Samples between the exact twiddles of DFTBin()'s recursive oscillator
+
+// DFT precision
+// Build with DFT_SINGLE_PRECISION set to 1 (see build/CMakeLists.txt) to run the DFT analysis in float32 using libfftw3f.
+// Samples are converted to float32 once when they enter the DFT and the spectra stay in float32.
+#ifndef DFT_SINGLE_PRECISION
+#define DFT_SINGLE_PRECISION 0
+#endif
+#if DFT_SINGLE_PRECISION
+typedef float DFTReal;
+typedef fftwf_complex DFTComplex;
+typedef fftwf_plan FFTWPlan;
+#define FFTW(name) fftwf_##name
+#define DFT_SQRT sqrtf
+#else
+typedef double DFTReal;
+typedef fftw_complex DFTComplex;
+typedef fftw_plan FFTWPlan;
+#define FFTW(name) fftw_##name
+#define DFT_SQRT sqrt
+#endif
+typedef struct DFTPlanCacheEntry *DFTPlan; // A plan from the DFT plan cache, executed with ExecuteDFT() or ExecuteInverseDFT()
+
+// DFT backends
+// Selectable with dftBackend
+#define DFT_BACKEND_FFTW 0
+#define DFT_BACKEND_BUILTIN 1
+#define DFT_BACKEND_AUTO 2
+
+// Analysis workers
+#define MAX_ANALYSIS_WORKERS 8 // Most worker threads analysisWorkers can start
+
+// Built-in FFT
+// A mixed-radix Stockham FFT built into the programs, selectable with dftBackend in place of FFTW. The complex data is held as
+// separate real and imaginary arrays and every butterfly loops over contiguous elements, so the compiler vectorises the stages.
+// A real DFT of even length is calculated with a complex FFT of half the length.
+#define BUILTIN_FFT_MAX_STAGES 32
+#define BUILTIN_FFT_SLOTS (2 + MAX_ANALYSIS_WORKERS) // Sets of work buffers, so the callback or analysis thread, the channel DFT worker and the analysis workers can execute the same plan at once
+typedef struct {
+	int length; // Number of real samples transformed
+	int complexLength; // Length of the complex FFT: length/2 if length is even, otherwise length
+	int stages;
+	int radix[BUILTIN_FFT_MAX_STAGES]; // Radix 4 stages first, then radix 2, then the remaining prime factors
+	DFTReal *twiddleRe[BUILTIN_FFT_MAX_STAGES], *twiddleIm[BUILTIN_FFT_MAX_STAGES]; // W_n^(j*k) at [(k-1)*(n/radix) + j], n being the length the stage transforms
+	DFTReal *rootRe[BUILTIN_FFT_MAX_STAGES], *rootIm[BUILTIN_FFT_MAX_STAGES]; // W_radix^k, used by the generic butterfly
+	DFTReal *splitRe, *splitIm; // W_length^k for k <= length/2, which split the half length FFT into the real DFT
+	DFTReal *workRe[BUILTIN_FFT_SLOTS][2], *workIm[BUILTIN_FFT_SLOTS][2]; // Ping-pong buffers of complexLength elements
+	int tabulated; // Set once CreateBuiltinFFT() has filled the twiddle tables
+} BuiltinFFT;
+
+// Analysis ring
+// With analysisThread the callback only reads each block into the next free slot of this single-producer, single-consumer
+// ring and posts "ready". The analysis thread analyses the blocks in order and writes the CSV files and the console output.
+// Only the callback writes head and only the analysis thread writes tail, so the ring needs no lock.
+// Each program lays out the channels of a slot the way it reads them, with dataStride, inputStride and outputStride between them.
+#define MAX_TASKS 2 // Most DAQmx tasks a program reads each block from
+typedef struct {
+	float64 *data; // Samples of every channel of the block, carved from the arena; channel c starts at data[c*dataStride]
+	int32 *codes; // Raw reads only: codes of the block, laid out like data, which are scaled into data
+	int32 read[MAX_TASKS]; // Samples per channel read by each task
+	int32 skipped[MAX_TASKS]; // Samples per channel of the blocks dropped since the previous slot was published
+	DFTReal *input; // Analysis workers only: windowed or converted samples the DFT reads, if it cannot read data directly
+	DFTComplex *output; // Analysis workers only: spectra of every channel of the block; channel c starts at output[c*outputStride]
+	int transformed; // Analysis workers only: set once the spectra are ready, cleared once the block has been analysed
+	int hasSpectra; // Analysis workers only: 0 if the worker found no DFT plan, so the analysis thread transforms the block itself
+} AnalysisRingSlot;
+typedef void (*AnalyzeRingSlotFunction)(void *callbackData, AnalysisRingSlot *slot); // Analyses a block on the analysis thread
+typedef void (*TransformRingSlotFunction)(AnalysisRingSlot *slot); // Calculates the spectra of a block on an analysis worker
+typedef struct {
+	AnalysisRingSlot *slots;
+	int channels; // Channels in every slot
+	int dataStride, inputStride, outputStride; // Samples or bins from one channel of a slot to the next
+	AnalyzeRingSlotFunction analyze;
+	TransformRingSlotFunction transform;
+	unsigned int head; // Blocks published by the callback
+	unsigned int tail; // Blocks the analysis thread has finished with
+	sem_t ready; // Posted once per published block, or per transformed block with analysis workers, and once more to stop the thread
+	pthread_t thread;
+	int stopping; // Set once no more blocks will be published
+	sem_t pending; // Analysis workers only: posted once per published block, and once per worker to stop them
+	pthread_t workers[MAX_ANALYSIS_WORKERS];
+	unsigned int claimed; // Analysis workers only: blocks taken by a worker
+	unsigned int finished; // Analysis workers only: blocks whose spectra are ready
+	unsigned int reordered; // Analysis workers only: blocks finished out of the order they were read in
+	unsigned int highWater; // Most blocks waiting at once
+	unsigned long long occupancySum; // Blocks waiting each time one was published, for the mean occupancy
+	unsigned int dropped; // Blocks read while every slot was still waiting, which are not analysed
+	int32 skipped[MAX_TASKS]; // Samples per channel of dropped blocks and partial catch-up reads not yet passed on with a block
+} AnalysisRing;
+extern AnalysisRing analysisRing;
+
+// Raw reads
+// With rawReads the ADC codes are read and scaled to volts on the analysis side with the polynomial DAQmx reports
+// for each channel: volts = c0 + c1*code + c2*code^2 + ...
+#define MAX_SCALING_COEFFS 8
+typedef struct {
+	float64 coeffs[MAX_SCALING_COEFFS];
+	int numCoeffs;
+} RawScaling;
+
+// Catch-up reads
+// The backlog each callback finds with catchUpReads, in complete blocks waiting in the DAQmx buffer
+typedef struct {
+	int backlog; // At the latest callback
+	int maxBacklog;
+	unsigned long long backlogSum;
+	unsigned int callbacks;
+	unsigned int batches; // Reads of more than one block
+	unsigned int batchedBlocks; // Blocks read by those reads
+	unsigned int leftBehind; // Reads that could not drain the whole backlog
+} CatchUpStats;
+extern CatchUpStats catchUp;
+
+// Input buffer
+// Size of the DAQmx input buffer and the fill level the callback sees, in samples per channel
+typedef struct {
+	uInt32 size;
+	uInt32 warnLevel; // Samples waiting that raise the fill warning
+	uInt32 peakFill; // Most samples seen waiting
+	int warning; // 1 while the fill warning is raised
+	unsigned int warnings;
+	uInt32 warnedFill; // Fill level of the last warning raised by the callback and not yet printed, 0 if none
+} InputBufferState;
+extern InputBufferState inputBuffer;
+
+// DFT windows
+// Windows selectable with dftWindowType
+#define DFT_WINDOW_NONE 0
+#define DFT_WINDOW_HANN 1
+#define DFT_WINDOW_BLACKMAN_HARRIS 2
+#define DFT_WINDOW_FLAT_TOP 3
+#define DFT_WINDOW_KAISER 4
+
+// Spectrogram formats
+// Selectable with spectrogramFormat
+#define SPECTROGRAM_FLOAT32 0
+#define SPECTROGRAM_DB8 1
+
+// DFT threads
+// Build with DFT_THREADS set to 1 (see build/CMakeLists.txt) to link libfftw3_threads and split each DFT across dftThreads threads.
+#ifndef DFT_THREADS
+#define DFT_THREADS 0
+#endif
+
+// Spectrum kernel
+// The magnitudes, amplitudes and peak bin of the spectra are calculated with AVX2 on x64 processors that support it
+// (checked at runtime, so the build still runs on older controllers) and with NEON on ARM targets built with -mfpu=neon.
+// ARMv7 NEON has no double precision, so it is only used with DFT_SINGLE_PRECISION.
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define SPECTRUM_AVX2 1
+#elif (defined(__ARM_NEON) || defined(__ARM_NEON__)) && DFT_SINGLE_PRECISION
+#include <arm_neon.h>
+#define SPECTRUM_NEON 1
+#endif
+
+// Harmonic analysis
+// Distortion of one channel, measured from each block's spectrum when harmonicAnalysis is enabled
+typedef struct {
+	double fundamentalFreq; // Hz
+	double thdDb; // Total harmonic distortion, relative to the fundamental
+	double sinadDb; // Signal to noise and distortion ratio
+	double sfdrDb; // Spurious free dynamic range, relative to the fundamental
+	double fundamentalAmplitude; // Peak amplitude of the fundamental in volts
+	double enob; // Effective number of bits, from SINAD corrected to a full-scale fundamental
+} HarmonicResult;
+#define HARMONIC_POWER_FLOOR 1e-20 // Fraction of the total power every power is floored at (-200 dB), so the dB ratios stay finite
+
+// DFT plan cache
+// DFT plans are created once at startup and reused on every callback through ExecuteDFT().
+// A plan may only be executed on buffers with the same length, channel count, placement, and alignment it was created with, so those form the key.
+// GetDFTPlan() returns NULL once the cache is full, and every caller skips the work that needed the plan.
+#define DFT_STARTUP_PLANS 4 // Most plans InitDFTPlanCache() creates: the block DFT, the spectrogram, GCC-PHAT and the zoom FFT
+#define DFT_PLAN_CACHE_SIZE (2 * DFT_STARTUP_PLANS) // The startup plans, and room for as many buffers of another alignment met while acquiring
+typedef struct DFTPlanCacheEntry {
+	int length; // Number of real samples transformed per channel
+	int channels; // Number of channels transformed by one execution
+	int precision; // Size in bytes of a real sample (sizeof(DFTReal))
+	int inverse; // Nonzero for a complex-to-real (inverse) DFT
+	int inPlace; // Nonzero if the plan writes its output over its input
+	int inAlignment; // fftw_alignment_of() the input buffer
+	int outAlignment; // fftw_alignment_of() the output buffer
+	int backend; // DFT_BACKEND_FFTW or DFT_BACKEND_BUILTIN, whichever executes the plan
+	FFTWPlan fftwPlan; // NULL with DFT_BACKEND_BUILTIN
+	BuiltinFFT *builtinFFT; // NULL unless the built-in backend may execute the plan
+	double fftwMs, builtinMs; // Time per execution of each backend, if DFT_BACKEND_AUTO compared them
+} DFTPlanCacheEntry;
+typedef struct {
+	DFTPlanCacheEntry entries[DFT_PLAN_CACHE_SIZE];
+	int count;
+	int acquiring; // Set once startup planning is complete
+	int plansCreatedAtStartup;
+	int plansCreatedDuringAcquisition; // Should remain 0; any plan created here ran on the callback thread
+	int plansRefused; // Lookups that found the cache full, whose work was skipped
+	int wisdomImported; // Nonzero if the wisdom file was read at startup
+	int plansFromWisdom; // Plans created from wisdom without measuring
+	int plansMeasured; // Plans measured at startup with dftPlannerFlag
+	double planningTimeSec; // Time spent in InitDFTPlanCache()
+	BuiltinFFT *builtinFFTs[DFT_PLAN_CACHE_SIZE]; // Built-in FFTs carved from the arena, shared by every plan of their length
+	int builtinFFTLengths[DFT_PLAN_CACHE_SIZE];
+	int builtinFFTCount;
+} DFTPlanCache;
+extern DFTPlanCache dftPlanCache;
+
+// Single precision accuracy report
+typedef struct {
+	int blocks; // Blocks compared
+	int blocksSeen; // Blocks counted by PrecisionCheckDue()
+	int blocksOverTolerance; // Blocks where the difference exceeded phaseSkewToleranceDeg
+	double maxPhaseSkewErrorDeg; // Largest difference between the float32 and float64 phase skew
+} PrecisionReport;
+extern PrecisionReport precisionReport;
+
+// Tone tracker state
+typedef struct {
+	int candidateBin; // Peak bin of the previous full DFT
+	int stableBlocks; // Consecutive full DFTs with the peak in candidateBin
+	int locked; // Nonzero while only the tracked bins are evaluated
+	int bin; // Tracked bin
+	double lockedMagnitude; // DSA magnitude of the tracked bin when tracking started
+} ToneTracker;
+extern ToneTracker toneTracker;
+
+// Acquisition arena
+// Every sample, spectrum and scratch buffer used on the acquisition path is carved out of one block allocated at startup,
+// once the task is configured, so processing a block never allocates memory. Each buffer starts on a cache line boundary.
+// Each program carves its own sample and spectrum buffers, and those of the shared analysis, with ArenaAlloc().
+// SyncCommon/test checks that no block after the first allocates.
+#define ARENA_ALIGNMENT 64
+typedef struct {
+	char *block; // The allocated block; base is aligned within it
+	char *base;
+	size_t size; // Bytes carved out of the block
+	size_t used;
+} ArenaAllocator;
+typedef void (*CarveArenaFunction)(int length, int channels); // Carves every buffer of a program with ArenaAlloc()
+extern ArenaAllocator arenaAllocator;
+
+// Multi-tone detection
+#define MAX_TONES 64
+typedef struct {
+	int bin;
+	double freq; // Hz
+	double amplitude[MAX_CHANNELS]; // V
+	double skewDeg[MAX_CHANNELS]; // Phase skew of each channel against the first one
+	double skewSec[MAX_CHANNELS];
+} Tone;
+extern Tone detectedTones[MAX_TONES]; // Tones found in the latest block, in order of frequency
+extern int numDetectedTones;
+
+// Multi-tone detection buffers, carved from the arena
+typedef struct {
+	double *power; // Weakest channel power of every bin
+	double *scratch; // Copy of power to select the median from
+} ToneDetector;
+extern ToneDetector toneDetector;
+
+// GCC-PHAT buffers, carved from the arena
+typedef struct {
+	int pairs; // Channels measured against the first one
+	DFTComplex *cross; // PHAT weighted cross-spectra of every channel but the first
+	DFTReal *correlation; // Cross-correlations of every channel but the first
+} GccPhatState;
+extern GccPhatState gccPhatState;
+
+// DFT window
+extern DFTReal *dftWindow; // Window applied to the samples as they are loaded into the DFT, NULL when unwindowed
+extern double dftWindowCoherentGain; // Mean of the window, used to correct the amplitudes of tones
+extern double dftWindowNoiseGain; // Mean square of the window, used to correct the noise density
+
+// Sliding DFT state
+#define SLIDING_BINS 5 // The tracked bin and two neighbours on each side, enough to apply a Hann window and interpolate
+typedef struct {
+	int bin; // Tracked bin
+	int blocksSinceSync; // Blocks since the state was last recalculated from the samples
+	long long samplesProcessed; // Samples per channel slid through so far, used to time stamp the updates
+	double *history; // The last sampsPerChan samples of every channel; channel c starts at history[c*sampsPerChan]. Carved from the arena.
+	double state[MAX_CHANNELS][SLIDING_BINS][2]; // DFT of the tracked bins over the current window
+} SlidingDFTState;
+extern SlidingDFTState slidingDFTState;
+
+// Zoom FFT state
+// The band around the peak bin is mixed down to 0 Hz, low-pass filtered and decimated to 4*zoomSpanBins bins, and the
+// decimated samples are zero padded and transformed with a plan from the DFT plan cache, so the zoom runs in the
+// precision and on the backend of the other DFTs. Everything that does not depend on the samples or the peak bin is
+// precomputed by InitZoomFFT() in buffers carved from the arena.
+typedef struct {
+	int length; // Samples per channel in a block
+	int decimatedLength; // Decimated samples per channel
+	int fftLength; // 4*(zoomPoints-1), so adjacent FFT bins are binStep DFT bins apart. 0 if the zoom is disabled.
+	double binStep; // Spacing of the evaluated frequencies in DFT bins
+	DFTReal *twiddleRe, *twiddleIm; // cos and -sin of 2*pi*m/length, used to mix the peak bin down to 0 Hz
+	int *segmentStart; // First sample of each segment; the samples of segment m lie between decimated samples m and m+1
+	DFTReal *weight; // Share of each sample added to the decimated sample at the start of its segment; the rest goes to the next
+	DFTReal *input[2]; // Real and imaginary parts of the decimated samples of one channel, zero padded to fftLength
+	DFTComplex *spectrum[2]; // Real DFTs of input[0] and input[1]
+	double *gain; // Gain of the filter at each of the zoomPoints frequencies, divided out of the band
+	DFTComplex *band; // zoomPoints values of every channel
+} ZoomFFTState;
+extern ZoomFFTState zoomFFTState;
+
+// Spectrogram
+// The spectrogram file starts with a SpectrogramHeader, followed by one frame per STFT hop. A frame holds the bins of
+// every channel in turn, either as float32 amplitudes (V) or as dB (re 1 V) quantised to 8 bits between
+// spectrogramMinDb and spectrogramMaxDb. Every spectrogramIndexInterval frames a SpectrogramIndexEntry is appended to
+// the index file, so a reader can seek to a time without scanning the whole spectrogram.
+typedef struct {
+	char magic[4]; // "STFT"
+	uint32_t version; // 1
+	uint32_t channels;
+	uint32_t frameLength; // Samples per frame
+	uint32_t hop; // Samples between the starts of consecutive frames
+	uint32_t bins; // frameLength/2+1
+	uint32_t format; // SPECTROGRAM_FLOAT32 or SPECTROGRAM_DB8
+	uint32_t reserved;
+	double sampleRate;
+	double minDb, maxDb; // Range of SPECTROGRAM_DB8
+} SpectrogramHeader;
+typedef struct {
+	uint64_t frame; // Frame number
+	uint64_t sample; // Sample number of the first sample of the frame
+	uint64_t offset; // Byte offset of the frame in the spectrogram file
+	double time; // Wall clock time when the frame was written, in seconds since the epoch
+} SpectrogramIndexEntry;
+typedef struct {
+	FILE *file;
+	FILE *indexFile;
+	char *fileBuffer; // stdio buffer of the spectrogram file, so frames reach the disk in large writes. Carved from the arena, so DestroySpectrogram() must close the file before the arena is destroyed.
+	double *history; // Samples of every channel that frames still need, followed by the new block. Carved from the arena.
+	DFTReal *frame; // Windowed frame of one channel. Carved from the arena.
+	DFTComplex *spectrum; // Spectrum of the frame. Carved from the arena.
+	void *row; // Bins of every channel in the file format. Carved from the arena.
+	DFTReal *window; // Window applied to every frame. Carved from the arena.
+	double amplitudeScale; // Converts a magnitude to a tone amplitude
+	int historyLength; // Room for the samples of each channel a frame may still need, plus one block
+	int held; // Samples of each channel kept in the history from earlier blocks
+	int nextFrame; // Start of the next frame in the history
+	long long firstSample; // Sample number of the first sample in the history
+	long long frames; // Frames written so far
+	size_t frameBytes;
+} SpectrogramState;
+extern SpectrogramState spectrogramState;
+
+// Welch averaged spectra
+// Each block adds its cross-spectrum against the first (DSA) channel and its auto-spectrum, so a block costs one
+// complex multiply-accumulate per bin. The fixed window keeps the spectra of the last welchBlocks blocks and stores
+// running sums instead of averages, which does not change the phase. Without welchAveraging the spectra of the
+// latest block are kept for the group delay estimator. The spectra are carved from the arena by CarveAnalysisBuffers().
+typedef struct {
+	int numBins; // Bins per channel
+	int numChannels;
+	int blocks; // Blocks accumulated so far
+	int slot; // Fixed window only: the slot of the oldest block, which is replaced next
+	double (*crossSpectrum)[2]; // X0*conj(Xc) of every channel c; channel c starts at crossSpectrum[c*numBins]. Channel 0 is unused.
+	double *autoSpectrum; // |Xc|^2 of every channel c; channel c starts at autoSpectrum[c*numBins]
+	double (*crossHistory)[2]; // Fixed window only: the cross-spectra of the last welchBlocks blocks; slot s starts at crossHistory[s*numChannels*numBins]
+	double *autoHistory; // Fixed window only: the auto-spectra of the last welchBlocks blocks
+	double *fitWeight; // Group delay only: weight of every bin in the phase fit, 0 if the bin is left out
+	int *fitBins; // Group delay only: the bins with a nonzero weight
+} WelchAverager;
+extern WelchAverager welchAverager;
+
+// Channel DFT worker
+// With concurrentChannelDFTs the MIO channel is transformed on this thread while the callback thread transforms the DSA channel
+typedef struct {
+	int running; // Set while the thread is started
+	pthread_t thread;
+	sem_t start; // Posted when a transform is ready to run
+	sem_t done; // Posted when the transform has finished
+	int stop; // Set to end the thread
+	DFTPlan plan;
+	int length;
+	double *data; // Samples to load into the input
+	DFTReal *input;
+	DFTComplex *output;
+} ChannelDFTWorker;
+extern ChannelDFTWorker channelDFTWorker;
+
+// Analysis options, set in SyncOptions.c
+extern const int rawReads;
+extern const int catchUpReads;
+extern const int maxCatchUpBlocks;
+extern const int sizeInputBuffer;
+extern const float64 consumerStallBudgetSec;
+extern const float64 maxInputBufferMemoryFraction;
+extern const float64 bufferFillWarning;
+extern const int analysisThread;
+extern const int analysisRingSlots;
+extern const int analysisWorkers;
+extern const int dftBackend;
+extern const double dftBackendBenchmarkSec;
+extern const unsigned int dftPlannerFlag;
+extern const char *fftwWisdomFileName;
+extern const int measureOnWisdomMiss;
+extern const int dftThreads;
+extern const unsigned long dftCoreMask;
+extern const int dftThreadBenchmark;
+extern const int logSpectrum;
+extern const int spectrumKernelBenchmark;
+extern const int comparePrecision;
+extern const int precisionCheckBlocks;
+extern const double phaseSkewToleranceDeg;
+extern const int dftWindowType;
+extern const double kaiserBeta;
+extern const int interpolatedEstimator;
+extern const int zoomFFT;
+extern const int zoomSpanBins;
+extern const int zoomPoints;
+extern const int spectrogram;
+extern const int stftLength;
+extern const int stftHop;
+extern const int stftWindowType;
+extern const int spectrogramFormat;
+extern const double spectrogramMinDb;
+extern const double spectrogramMaxDb;
+extern const int spectrogramIndexInterval;
+extern const int spectrogramBufferBytes;
+extern const int slidingDFT;
+extern const int slidingHopSize;
+extern const int slidingResyncBlocks;
+extern const int welchAveraging;
+extern const double welchAlpha;
+extern const int welchBlocks;
+extern const int groupDelayEstimator;
+extern const double groupDelayMinLevelDb;
+extern const double groupDelayMinCoherence;
+extern const int gccPhatEstimator;
+extern const int harmonicAnalysis;
+extern const int numHarmonics;
+extern const int harmonicLeakageBins;
+extern const int multiToneDetection;
+extern const int multiToneCount;
+extern const double multiToneThresholdDb;
+extern const double multiToneMinLevelDb;
+extern const int toneTracking;
+extern const int trackingLockBlocks;
+extern const int trackingNeighbourBins;
+extern const double trackingMagnitudeDrop;
+extern const char *voltageDataFileName;
+extern const char *dftDataFileName;
+extern const char *slidingSkewDataFileName;
+extern const char *gccPhatDataFileName;
+extern const char *harmonicDataFileName;
+extern const char *multiToneDataFileName;
+extern const char *spectrogramFileName;
+extern const char *spectrogramIndexFileName;
+extern const int voltageDataFileLogPrecision;
+extern const int dftDataFileLogPrecision;
+
+// DAQmx options, set at the top of each program
+extern const float64 sampleRate;
+extern const uInt64 sampsPerChan;
+
+// Acquisition arena
+void InitAcquisitionArena(CarveArenaFunction carve, int length, int channels);
+void *ArenaAlloc(size_t bytes);
+void CarveAnalysisBuffers(int length, int channels);
+void DestroyAcquisitionArena(void);
+
+// DFT plan cache and backends
+void StoreData(int length, int numChannels, double *dataToAllocate, DFTReal *window, DFTReal *output);
+int InitDFTPlanCache(int length, int channels, DFTReal *real, DFTComplex *complex);
+DFTPlan GetDFTPlan(int length, int channels, int inverse, DFTReal *real, DFTComplex *complex);
+FFTWPlan CreateDFTPlan(int length, int channels, int inverse, DFTReal *real, DFTComplex *complex, unsigned int flags);
+void DestroyDFTPlanCache(void);
+const char *DFTBackendName(int backend);
+void ExecuteDFT(DFTPlan plan, DFTReal *real, DFTComplex *complex);
+void ExecuteInverseDFT(DFTPlan plan, DFTComplex *complex, DFTReal *real);
+void SelectDFTBackend(DFTPlan plan, DFTReal *real, DFTComplex *complex);
+double TimeDFTBackend(DFTPlan plan, int backend, DFTReal *real, DFTComplex *complex);
+void ReportDFTBackends(void);
+void FactorBuiltinFFT(BuiltinFFT *fft, int length);
+void CarveBuiltinFFT(int length);
+BuiltinFFT *CreateBuiltinFFT(int length);
+void BuiltinRealFFT(BuiltinFFT *fft, int slot, DFTReal *real, DFTComplex *complex);
+void BuiltinInverseRealFFT(BuiltinFFT *fft, int slot, DFTComplex *complex, DFTReal *real);
+int BuiltinComplexFFT(BuiltinFFT *fft, int slot);
+void BuiltinRadix2(int s, int m, const DFTReal *twRe, const DFTReal *twIm, const DFTReal *restrict xr, const DFTReal *restrict xi, DFTReal *restrict yr, DFTReal *restrict yi);
+void BuiltinRadix4(int s, int m, const DFTReal *twRe, const DFTReal *twIm, const DFTReal *restrict xr, const DFTReal *restrict xi, DFTReal *restrict yr, DFTReal *restrict yi);
+void BuiltinRadixGeneric(int p, int s, int m, const DFTReal *twRe, const DFTReal *twIm, const DFTReal *rootRe, const DFTReal *rootIm,
+	const DFTReal *restrict xr, const DFTReal *restrict xi, DFTReal *restrict yr, DFTReal *restrict yi);
+
+// DFT threads
+void InitDFTThreads(void);
+void DestroyDFTThreads(void);
+void InitChannelDFTWorker(void);
+void DestroyChannelDFTWorker(void);
+void *ChannelDFTWorkerThread(void *arg);
+void StartChannelDFT(DFTPlan plan, int length, double *data, DFTReal *input, DFTComplex *output);
+void WaitForChannelDFT(void);
+void RestrictToDFTCores(pthread_t thread);
+void RestrictDFTThreadPool(DFTPlan plan, DFTReal *real, DFTComplex *complex);
+void RunDFTThreadBenchmark(int maxLength, int channels);
+
+// Spectral analysis
+void GoertzelBins(double *data, DFTReal *window, int stride, int length, int firstBin, int numBins, DFTComplex *output);
+int ToneStillTracked(DFTComplex **outputs, int numChannels, int firstBin, int numBins);
+void UpdateToneTracker(int peakBin, double peakMagnitude);
+void DFTBin(double *data, DFTReal *window, int stride, int length, int bin, double *realComp, double *imagComp);
+int PrecisionCheckDue(void);
+void ComparePhaseSkewPrecision(double *dsaData, double *mioData, int stride, int length, int bin, double phaseSkewDeg);
+double NormalizePhaseAngleDifference(double phase);
+void InitDFTWindow(int length);
+double WindowValue(int type, int i, int length);
+double BesselI0(double x);
+double BinMagnitude(DFTReal *bin);
+double InterpolateHannPeak(double magnitudeBelow, double magnitudePeak, double magnitudeAbove);
+void SlidingDFTBlock(double **channels, int stride, int numChannels, int length, int bin, double sampleRate, FILE *file);
+void WelchAccumulate(DFTComplex **outputs, int firstBin, int numBins);
+double WelchPhaseSkewDeg(int channel, int bin);
+int GroupDelaySkewSec(int channel, double binPrecision, double *skewSec);
+int GccPhatDelays(DFTComplex **outputs, int numChannels, int length, double *delays);
+void PhatCrossSpectrum(DFTComplex *dsa, DFTComplex *channel, int numBins, DFTComplex *cross);
+double CorrelationPeakDelay(DFTReal *correlation, int stride, int length);
+int SpectrumKernel(DFTComplex **outputs, int numChannels, int numBins, DFTReal amplitudeScale, DFTReal **magnitudes, DFTReal **amplitudes);
+int SpectrumKernelScalar(DFTComplex **outputs, int numChannels, int numBins, DFTReal amplitudeScale, DFTReal **magnitudes, DFTReal **amplitudes, int firstBin, int peak, DFTReal peakPower);
+#if SPECTRUM_AVX2
+int SpectrumKernelAVX2(DFTComplex **outputs, int numChannels, int numBins, DFTReal amplitudeScale, DFTReal **magnitudes, DFTReal **amplitudes);
+#elif SPECTRUM_NEON
+int SpectrumKernelNEON(DFTComplex **outputs, int numChannels, int numBins, DFTReal amplitudeScale, DFTReal **magnitudes, DFTReal **amplitudes);
+#endif
+const char *SpectrumKernelName(void);
+int PerBinSpectrumLoop(DFTComplex **outputs, int numChannels, int numBins, DFTReal amplitudeScale, DFTReal **magnitudes, DFTReal **amplitudes);
+void RunSpectrumKernelBenchmark(int numChannels);
+void AnalyzeHarmonics(DFTComplex *spectrum, int length, int peakBin, double binPrecision, double fullScaleVolts, HarmonicResult *result);
+double BinPower(DFTComplex *spectrum, int bin, int length);
+int StrongestBinNear(DFTComplex *spectrum, int length, int bin, int range);
+double BandPower(DFTComplex *spectrum, int length, int bin, int range);
+void DetectTones(DFTComplex **spectra, int numChannels, int length, double binPrecision);
+double SelectKth(double *values, int count, int k);
+void SizeZoomFFT(int length);
+void InitZoomFFT(void);
+int ZoomTone(double **channels, int numChannels, int peakBin, double binPrecision, double *freq, double *phaseDeg);
+void InitSpectrogram(int length, int numChannels, double sampleRate);
+void SpectrogramBlock(double **channels, int numChannels, int length);
+void DestroySpectrogram(void);
+
+// Analysis ring
+void CarveAnalysisRing(int length, int channels, int padChannels);
+void InitAnalysisRing(void *callbackData, AnalyzeRingSlotFunction analyze, TransformRingSlotFunction transform);
+AnalysisRingSlot *NextFreeRingSlot(void);
+void SkipSamples(const int32 *samples);
+void TakeSkippedSamples(int32 *skipped);
+void PublishRingSlot(AnalysisRingSlot *slot, const int32 *read);
+void *AnalysisThread(void *arg);
+void DestroyAnalysisRing(void);
+int AnalysisWorkerCount(void);
+void *AnalysisWorkerThread(void *arg);
+
+// DAQmx reads
+int CatchUpBlocks(uInt32 available);
+int CompleteBatchBlocks(const int32 *read, int numTasks);
+int32 ConfigureInputBuffers(TaskHandle *tasks, int numTasks, int totalChannels);
+void WatchInputBuffer(uInt32 available);
+void ReportInputBufferWarning(void);
+int32 InitRawScaling(TaskHandle task, const char *channel, RawScaling *scaling);
+void ScaleRawCodes(const int32 *codes, const RawScaling *scaling, int length, float64 *volts);
+void ScaleRawCodesScalar(const int32 *codes, const RawScaling *scaling, int first, int length, float64 *volts);
+#if SPECTRUM_AVX2
+void ScaleRawCodesAVX2(const int32 *codes, const RawScaling *scaling, int length, float64 *volts);
+#endif
+
+#endif // SYNC_COMMON_H
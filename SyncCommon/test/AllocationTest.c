@@ -0,0 +1,254 @@
+/*********************************************************************
+*
+* AllocationTest.c
+*
+* Description:
+*    Checks that SmplClkSync, with every analysis feature turned on
+*    in AllocationTestOptions.c, neither allocates memory nor makes
+*    a large stack allocation once the first block has been analysed.
+*
+*    The program is compiled into this test with its main() renamed,
+*    and its callback is driven with synthetic blocks from the
+*    DAQmx stubs below instead of a device. malloc, calloc and
+*    realloc are replaced by counting versions, which also count the
+*    allocations made inside the C library, and fftw_malloc (or
+*    fftwf_malloc) is wrapped at link time with -Wl,--wrap. Any
+*    allocation after the first block fails the test.
+*
+*    Every thread, including the analysis thread and workers, runs
+*    on a stack of TEST_STACK_BYTES. The test is built with
+*    -fstack-clash-protection, so a stack allocation larger than
+*    that hits the guard page and crashes the test, and with
+*    -Werror=frame-larger-than, which rejects large fixed frames.
+*
+*    Requires glibc for __libc_malloc() and
+*    pthread_setattr_default_np().
+*
+*********************************************************************/
+
+#define _GNU_SOURCE // For pthread_setattr_default_np()
+#define main SmplClkSyncMain
+#include "SmplClkSync.c"
+#undef main
+
+#include <unistd.h>
+#include <sched.h>
+
+#define TEST_STACK_BYTES (256 * 1024) // Stack of every thread the test runs
+#define TEST_BLOCKS 150 // Callbacks after the first block; more than slidingResyncBlocks and welchBlocks
+#define TEST_FREQ 1000.0 // Frequency of the synthetic tone in Hz
+#define TEST_DELAY_SEC 2e-6 // Delay of the MIO channel behind the DSA channel
+#define TEST_CODE_VOLTS (10.0 / 8388608) // Volts per code of the stubbed raw reads
+
+static volatile int countAllocations = 0; // Set once the first block has been analysed
+static int allocations = 0; // Allocations made while countAllocations is set
+static uInt64 samplesRead[2]; // Samples per channel read so far from the DSA and MIO tasks
+static int callbacks = 0;
+
+/*********************************************/
+// Allocation counters
+/*********************************************/
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *pointer, size_t size);
+
+// Counts an allocation if the first block has been analysed
+void CountAllocation(void)
+{
+	if (countAllocations)
+		__sync_fetch_and_add(&allocations,1);
+}
+
+void *malloc(size_t size)
+{
+	CountAllocation();
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size)
+{
+	CountAllocation();
+	return __libc_calloc(count,size);
+}
+
+void *realloc(void *pointer, size_t size)
+{
+	CountAllocation();
+	return __libc_realloc(pointer,size);
+}
+
+// Only the FFTW library of the DFT precision is linked and wrapped
+#if DFT_SINGLE_PRECISION
+void *__real_fftwf_malloc(size_t size);
+void *__wrap_fftwf_malloc(size_t size)
+{
+	CountAllocation();
+	return __real_fftwf_malloc(size);
+}
+#else
+void *__real_fftw_malloc(size_t size);
+void *__wrap_fftw_malloc(size_t size)
+{
+	CountAllocation();
+	return __real_fftw_malloc(size);
+}
+#endif
+
+/*********************************************/
+// DAQmx stubs
+/*********************************************/
+// The DSA task is handle 1 and the MIO task handle 2. Each read returns the next samples of a tone with its second
+// harmonic and a weaker second tone, delayed by TEST_DELAY_SEC on the MIO task.
+double SyntheticSample(TaskHandle task, uInt64 i)
+{
+	double t = i / sampleRate - (task == (TaskHandle)2 ? TEST_DELAY_SEC : 0);
+	return sin(2 * PI * TEST_FREQ * t) + 0.01 * sin(2 * PI * 2 * TEST_FREQ * t) + 0.1 * sin(2 * PI * 1730 * t);
+}
+
+int32 DAQmxReadAnalogF64(TaskHandle taskHandle, int32 numSampsPerChan, float64 timeout, bool32 fillMode, float64 readArray[], uInt32 arraySizeInSamps, int32 *sampsPerChanRead, bool32 *reserved)
+{
+	uInt64 *position = &samplesRead[taskHandle == (TaskHandle)2];
+	for (int i = 0; i < numSampsPerChan; i++)
+		readArray[i] = SyntheticSample(taskHandle,*position + i);
+	*position += numSampsPerChan;
+	*sampsPerChanRead = numSampsPerChan;
+	return 0;
+}
+
+int32 DAQmxReadBinaryI32(TaskHandle taskHandle, int32 numSampsPerChan, float64 timeout, bool32 fillMode, int32 readArray[], uInt32 arraySizeInSamps, int32 *sampsPerChanRead, bool32 *reserved)
+{
+	uInt64 *position = &samplesRead[taskHandle == (TaskHandle)2];
+	for (int i = 0; i < numSampsPerChan; i++)
+		readArray[i] = (int32)lrint(SyntheticSample(taskHandle,*position + i) / TEST_CODE_VOLTS);
+	*position += numSampsPerChan;
+	*sampsPerChanRead = numSampsPerChan;
+	return 0;
+}
+
+// Every seventh callback finds a backlog of three blocks, so the catch-up reads are exercised
+int32 DAQmxGetReadAvailSampPerChan(TaskHandle taskHandle, uInt32 *data)
+{
+	*data = (callbacks % 7 == 6 ? 3 : 1) * sampsPerChan;
+	return 0;
+}
+
+int32 DAQmxGetAIDevScalingCoeff(TaskHandle taskHandle, const char channel[], float64 *data, uInt32 arraySizeInElements)
+{
+	if (arraySizeInElements == 0)
+		return 2;
+	data[0] = 0;
+	data[1] = TEST_CODE_VOLTS;
+	return 0;
+}
+
+int32 DAQmxGetExtendedErrorInfo(char errorString[], uInt32 bufferSize)
+{
+	snprintf(errorString,bufferSize,"DAQmx stub error");
+	return 0;
+}
+
+// The configuration calls of the program's main() are never made by the test
+int32 DAQmxCreateTask(const char taskName[], TaskHandle *taskHandle) { return 0; }
+int32 DAQmxCreateAIVoltageChan(TaskHandle taskHandle, const char physicalChannel[], const char nameToAssignToChannel[], int32 terminalConfig, float64 minVal, float64 maxVal, int32 units, const char customScaleName[]) { return 0; }
+int32 DAQmxCfgSampClkTiming(TaskHandle taskHandle, const char source[], float64 rate, int32 activeEdge, int32 sampleMode, uInt64 sampsPerChanToAcquire) { return 0; }
+int32 DAQmxSetAIRemoveFilterDelay(TaskHandle taskHandle, const char channel[], bool32 data) { return 0; }
+int32 DAQmxGetSampClkTerm(TaskHandle taskHandle, char *data, uInt32 bufferSize) { return 0; }
+int32 DAQmxSetSampClkSrc(TaskHandle taskHandle, const char *data) { return 0; }
+int32 DAQmxGetStartTrigTerm(TaskHandle taskHandle, char *data, uInt32 bufferSize) { return 0; }
+int32 DAQmxCfgDigEdgeStartTrig(TaskHandle taskHandle, const char triggerSource[], int32 triggerEdge) { return 0; }
+int32 DAQmxCfgInputBuffer(TaskHandle taskHandle, uInt32 numSampsPerChan) { return 0; }
+int32 DAQmxGetBufInputBufSize(TaskHandle taskHandle, uInt32 *data) { *data = 0; return 0; }
+int32 DAQmxRegisterEveryNSamplesEvent(TaskHandle task, int32 everyNsamplesEventType, uInt32 nSamples, uInt32 options, DAQmxEveryNSamplesEventCallbackPtr callbackFunction, void *callbackData) { return 0; }
+int32 DAQmxRegisterDoneEvent(TaskHandle task, uInt32 options, DAQmxDoneEventCallbackPtr callbackFunction, void *callbackData) { return 0; }
+int32 DAQmxStartTask(TaskHandle taskHandle) { return 0; }
+int32 DAQmxStopTask(TaskHandle taskHandle) { return 0; }
+int32 DAQmxClearTask(TaskHandle taskHandle) { return 0; }
+
+/*********************************************/
+// Test
+/*********************************************/
+// Waits until the analysis thread has finished every block published so far
+void WaitForAnalysis(void)
+{
+	while (analysisThread && __atomic_load_n(&analysisRing.tail,__ATOMIC_ACQUIRE) != __atomic_load_n(&analysisRing.head,__ATOMIC_ACQUIRE))
+		sched_yield();
+}
+
+// Sets the program up as its main() does, runs one callback, then counts the allocations of TEST_BLOCKS more
+void *RunAllocationTest(void *result)
+{
+	LogFile voltageDataFile = {fopen(voltageDataFileName,"w"), voltageDataFileLogPrecision};
+	LogFile dftDataFile = {fopen(dftDataFileName,"w"), dftDataFileLogPrecision};
+	LogFile slidingSkewDataFile = {fopen(slidingSkewDataFileName,"w"), dftDataFileLogPrecision};
+	LogFile gccPhatDataFile = {fopen(gccPhatDataFileName,"w"), dftDataFileLogPrecision};
+	LogFile harmonicDataFile = {fopen(harmonicDataFileName,"w"), dftDataFileLogPrecision};
+	LogFile multiToneDataFile = {fopen(multiToneDataFileName,"w"), dftDataFileLogPrecision};
+	Logs logData = {voltageDataFile, dftDataFile, slidingSkewDataFile, gccPhatDataFile, harmonicDataFile, multiToneDataFile};
+
+	DSATaskHandle = (TaskHandle)1;
+	MIOTaskHandle = (TaskHandle)2;
+	if (rawReads)
+	{
+		InitRawScaling(DSATaskHandle,physicalChannelDSA,&rawScaling[0]);
+		InitRawScaling(MIOTaskHandle,physicalChannelMIO,&rawScaling[1]);
+	}
+	InitDFTWindow(sampsPerChan);
+	InitDFTThreads();
+	if (concurrentChannelDFTs)
+		InitChannelDFTWorker();
+	InitAcquisitionArena(CarveAcquisitionArena,sampsPerChan,2);
+	if (zoomFFT)
+		InitZoomFFT();
+	if (spectrogram)
+		InitSpectrogram(sampsPerChan,2,sampleRate);
+	InitDFTPlanCache(sampsPerChan,1,arena.dsaInput,arena.dsaOutput);
+	if (analysisThread)
+		InitAnalysisRing(&logData,AnalyzeRingSlot,TransformBlock);
+
+	// The first block opens the stdio buffers of the log files and the console, so it may allocate
+	EveryNCallback(DSATaskHandle,everyNsamplesEventType,sampsPerChan,&logData);
+	WaitForAnalysis();
+	countAllocations = 1;
+	for (callbacks = 1; callbacks <= TEST_BLOCKS; callbacks++)
+	{
+		EveryNCallback(DSATaskHandle,everyNsamplesEventType,sampsPerChan,&logData);
+		WaitForAnalysis();
+	}
+	countAllocations = 0;
+
+	printf("\n\nBlocks read: %llu, dropped by the analysis ring: %u, catch-up batches: %u\n",samplesRead[0] / sampsPerChan,analysisRing.dropped,catchUp.batches);
+	printf("DFT plans created during acquisition: %d, lookups that found the cache full: %d\n",dftPlanCache.plansCreatedDuringAcquisition,dftPlanCache.plansRefused);
+	printf("Allocations after the first block: %d\n",allocations);
+	*(int*)result = allocations == 0 && dftPlanCache.plansRefused == 0 && analysisRing.dropped == 0 && (!catchUpReads || catchUp.batches > 0) ? 0 : 1;
+
+	DestroyAnalysisRing();
+	DestroyChannelDFTWorker();
+	DestroyDFTPlanCache();
+	DestroyDFTThreads();
+	FFTW(free)(dftWindow);
+	// The spectrogram file's stdio buffer is carved from the arena, so it is closed first
+	DestroySpectrogram();
+	DestroyAcquisitionArena();
+	DoneCallback(DSATaskHandle,0,&logData);
+	return NULL;
+}
+
+int main(void)
+{
+	int result = 1;
+	pthread_attr_t attributes;
+	pthread_t thread;
+
+	// Run the test, and every thread it starts, on small stacks
+	pthread_attr_init(&attributes);
+	pthread_attr_setstacksize(&attributes,TEST_STACK_BYTES);
+	if (pthread_setattr_default_np(&attributes) != 0 || pthread_create(&thread,NULL,RunAllocationTest,&result) != 0)
+	{
+		printf("Unable to start the test thread\n");
+		return 1;
+	}
+	pthread_join(thread,NULL);
+	pthread_attr_destroy(&attributes);
+	printf(result == 0 ? "PASSED\n" : "FAILED\n");
+	return result;
+}
@@ -0,0 +1,130 @@
+/*********************************************************************
+*
+* AllocationTestOptions.c
+*
+* Description:
+*    The analysis options of SyncOptions.c with every feature that
+*    runs on the acquisition path turned on, for AllocationTest.c.
+*    The startup benchmarks are left off.
+*
+*********************************************************************/
+
+#include "SyncCommon.h"
+
+/*********************************************/
+// Analysis Configuration Options
+/*********************************************/
+// Raw Read Options
+const int rawReads = 1; // Options: 1 (read the ADC codes with DAQmxReadBinaryI32, half the bytes of DAQmxReadAnalogF64, and scale them to volts with the polynomial from DAQmxGetAIDevScalingCoeff on the analysis thread or workers, if they are used; the codes are also logged in the voltage CSV file), 0 (read volts scaled by the driver). Requires the units of every channel to be DAQmx_Val_Volts.
+
+// Catch-Up Read Options
+const int catchUpReads = 1; // Options: 1 (each callback asks DAQmx how many samples are waiting and reads every complete block, up to maxCatchUpBlocks, in one read, so a transient stall is absorbed instead of overflowing the DAQmx buffer), 0 (each callback reads one block)
+const int maxCatchUpBlocks = 8; // The most blocks one catch-up read drains. Sets the size of the batch buffers.
+
+// Input Buffer Options
+const int sizeInputBuffer = 1; // Options: 1 (set the DAQmx input buffer of each task with DAQmxCfgInputBuffer to hold consumerStallBudgetSec of samples, so the callback can stall that long before the buffer overflows with error -200279), 0 (keep the size DAQmx picks from sampsPerChan)
+const float64 consumerStallBudgetSec = 2.0; // The longest, in seconds, the reads may fall behind the acquisition without losing samples.
+const float64 maxInputBufferMemoryFraction = 0.25; // The largest share of the available memory the input buffers may take. A buffer for consumerStallBudgetSec that needs more is reduced to fit and a warning is printed.
+const float64 bufferFillWarning = 0.5; // Fraction of the input buffer waiting to be read at which the callback raises a warning, which the analysis prints. The check asks DAQmx how many samples are waiting on every callback, unless catchUpReads already does. 0 disables the check.
+
+// Analysis Thread Options
+const int analysisThread = 1; // Options: 1 (the callback only reads each block into a ring of analysisRingSlots blocks, and a separate thread analyses the blocks and writes the CSV files and the console, so a slow disk cannot delay the next read), 0 (analyse each block on the callback thread)
+const int analysisRingSlots = 8; // The number of blocks the ring holds. A block read while every slot is still waiting to be analysed is dropped and counted.
+const int analysisWorkers = 2; // Only used with analysisThread. The number of worker threads that calculate the DFTs of blocks from the ring in parallel, at most MAX_ANALYSIS_WORKERS. The analysis thread takes the spectra back in the order the blocks were read, so the totals, CSV files and console rows stay sequential. Options: 1 (the analysis thread calculates the DFTs itself), 2 or more (for long DFTs of many channels that one thread cannot keep up with)
+
+// DFT Backend Options
+const int dftBackend = DFT_BACKEND_BUILTIN; // The FFT implementation that executes the DFT plans. Options: DFT_BACKEND_FFTW (libfftw3), DFT_BACKEND_BUILTIN (the mixed-radix FFT built into these programs, for controllers whose FFTW is slow or built without SIMD), DFT_BACKEND_AUTO (at startup, time both on every plan and use the faster one for each block size)
+const double dftBackendBenchmarkSec = 0.05; // Time spent timing each backend on each plan with DFT_BACKEND_AUTO.
+
+// FFTW Planning Options
+const unsigned int dftPlannerFlag = FFTW_ESTIMATE; // The planning rigor used to create the DFT plans at startup. Slower rigors find faster plans for non-power-of-two lengths. Options: FFTW_ESTIMATE, FFTW_MEASURE, FFTW_PATIENT, FFTW_EXHAUSTIVE
+#if DFT_SINGLE_PRECISION
+const char *fftwWisdomFileName = NULL; // Plans measured at startup are saved to this file and reused by later runs on the same controller. Set to NULL to disable. Ignored with FFTW_ESTIMATE.
+#else
+const char *fftwWisdomFileName = NULL; // Plans measured at startup are saved to this file and reused by later runs on the same controller. Set to NULL to disable. Ignored with FFTW_ESTIMATE.
+#endif
+const int measureOnWisdomMiss = 1; // Specifies what to do when the wisdom file has no plan for a transform. Options: 1 (measure the plan and update the wisdom file), 0 (fall back to FFTW_ESTIMATE so startup never measures)
+
+// FFTW Threading Options
+const int dftThreads = 2; // Only used when built with DFT_THREADS. The number of threads each DFT is split across. The batched plan of ChnlExpSync gives each thread its own channels, so the channels are transformed concurrently. Only pays off for long blocks, see dftThreadBenchmark.
+const unsigned long dftCoreMask = 0; // The cores the threads that calculate the DFTs may run on, one bit per core (0x6 is cores 1 and 2): the FFTW threads, the channel DFT worker, the analysis workers, and the analysis thread when it has no workers. The DAQmx callback thread is never restricted. 0 does not restrict them.
+const int dftThreadBenchmark = 0; // Options: 1 (at startup, time the DFT of blocks from 1024 samples up to sampsPerChan with 1 and dftThreads threads and print where the threads start to pay off), 0 (off)
+
+// Spectrum Kernel Options
+const int logSpectrum = 1; // Options: 1 (write the magnitude and amplitude of every bin to the DFT CSV file each block), 0 (only search the spectra for the peak bin, which needs no square roots)
+const int spectrumKernelBenchmark = 0; // Options: 1 (at startup, time the spectrum kernel against the per-bin loop it replaced on spectra of 1k, 64k and 1M bins and print the speedup), 0 (off)
+
+// DFT Precision Options
+const int comparePrecision = 1; // Only used when built with DFT_SINGLE_PRECISION. Options: 1 (also calculate the phase skew in float64 at the detected frequency every precisionCheckBlocks blocks and report the largest difference), 0 (off)
+const int precisionCheckBlocks = 10; // Only used with comparePrecision. The float64 phase skew costs two O(n) passes over the samples, so only every precisionCheckBlocks-th block is compared. 1 compares every block.
+const double phaseSkewToleranceDeg = 0.01; // The largest acceptable difference, in degrees, between the float32 and float64 phase skew.
+
+// DFT Window Options
+const int dftWindowType = DFT_WINDOW_HANN; // The window applied to the samples as they are loaded into the DFT, which reduces leakage into the magnitudes and the phase of the peak bin. Hann separates close tones, Blackman-Harris suppresses leakage from distant ones, flat-top gives the most accurate amplitudes, and Kaiser trades between them with kaiserBeta. Ignored by the interpolated estimator, which always uses Hann. Options: DFT_WINDOW_NONE, DFT_WINDOW_HANN, DFT_WINDOW_BLACKMAN_HARRIS, DFT_WINDOW_FLAT_TOP, DFT_WINDOW_KAISER
+const double kaiserBeta = 8.6; // Shape of the Kaiser window. Larger values lower the sidelobes and widen the main lobe.
+
+// Interpolated Estimator Options
+const int interpolatedEstimator = 1; // Options: 1 (apply a Hann window and interpolate the tone frequency and phase between bins, so accurate skew can be measured from much shorter blocks), 0 (report the frequency and phase of the peak bin)
+
+// Zoom FFT Options
+const int zoomFFT = 1; // Options: 1 (once the peak bin is found, evaluate zoomPoints frequencies across zoomSpanBins bins around it by mixing the band down to 0 Hz, decimating it and transforming it with a short FFT, and report the frequency and phase skew where the tone is strongest, for a resolution much finer than sampleRate/sampsPerChan without longer blocks), 0 (report the peak bin)
+const int zoomSpanBins = 2; // Width of the band evaluated around the peak bin, in DFT bins. The band is decimated to 4*zoomSpanBins bins before the FFT.
+const int zoomPoints = 65; // The number of frequencies evaluated across the band. The resolution is zoomSpanBins/(zoomPoints-1) bins and the FFT has 4*(zoomPoints-1) points. Should be odd so the peak bin is one of the frequencies, and must be at least zoomSpanBins+2.
+
+// Spectrogram Options
+const int spectrogram = 1; // Options: 1 (calculate a short-time Fourier transform of every channel through the whole acquisition and append it to a binary spectrogram file, for time-frequency views of transients), 0 (off)
+const int stftLength = 256; // Samples per STFT frame. The bins are sampleRate/stftLength apart.
+const int stftHop = 64; // Samples between the starts of consecutive frames. Frames overlap by stftLength-stftHop samples.
+const int stftWindowType = DFT_WINDOW_HANN; // Window applied to every frame. Options: as for dftWindowType
+const int spectrogramFormat = SPECTROGRAM_DB8; // Options: SPECTROGRAM_FLOAT32 (amplitudes in V, 4 bytes per bin), SPECTROGRAM_DB8 (amplitudes in dB re 1 V quantised between spectrogramMinDb and spectrogramMaxDb, 1 byte per bin)
+const double spectrogramMinDb = -160.0; // Range quantised by SPECTROGRAM_DB8. Levels outside it are clipped.
+const double spectrogramMaxDb = 20.0;
+const int spectrogramIndexInterval = 100; // An index entry is written every this many frames.
+const int spectrogramBufferBytes = 1 << 20; // Size of the write buffer of the spectrogram file. Frames are written to disk once it is full.
+
+// Sliding DFT Options
+const int slidingDFT = 1; // Options: 1 (slide the DFT of the detected frequency through each block and log the phase skew every slidingHopSize samples), 0 (only measure the phase skew once per block)
+const int slidingHopSize = 100; // The number of samples between sliding phase skew updates. Should be much smaller than sampsPerChan.
+const int slidingResyncBlocks = 100; // The sliding DFT is recalculated from the samples every this many blocks so rounding errors cannot accumulate.
+
+// Welch Averaging Options
+const int welchAveraging = 2; // Options: 0 (measure the phase skew from each block on its own), 1 (measure it from the exponentially averaged cross-spectrum), 2 (measure it from the cross-spectrum averaged over the last welchBlocks blocks)
+const double welchAlpha = 0.1; // Weight of the newest block in the exponential average. Smaller values average over more blocks.
+const int welchBlocks = 16; // The number of consecutive blocks averaged by the fixed window.
+
+// Group Delay Options
+const int groupDelayEstimator = 1; // Options: 1 (fit the cross-spectrum phase of every bin above the thresholds against frequency and report the slope as the skew, for broadband or multi-tone signals), 0 (use the phase of the detected bin)
+const double groupDelayMinLevelDb = -40.0; // Bins whose cross-spectrum is more than this many dB below the strongest bin are left out of the fit.
+const double groupDelayMinCoherence = 0.9; // Bins with a lower magnitude squared coherence are left out of the fit. Only effective with welchAveraging, since a single block always has a coherence of 1.
+
+// GCC-PHAT Options
+const int gccPhatEstimator = 1; // Options: 1 (measure the skew as the delay of the peak of the PHAT weighted cross-correlation, for random or transient signals; disables tone tracking), 0 (use the phase of the detected bin)
+
+// Harmonic Analysis Options
+const int harmonicAnalysis = 1; // Options: 1 (measure the THD, SINAD, SFDR and ENOB of every channel from each block's spectrum and log them with the phase skew; disables tone tracking. The ENOB is corrected to a full-scale signal on the range set by minVal and maxVal), 0 (off)
+const int numHarmonics = 5; // The number of harmonics, starting from the 2nd, included in the THD.
+const int harmonicLeakageBins = 3; // The power of each tone is summed over this many bins on either side of its peak. Should cover the main lobe of the window, e.g. 1 with coherent sampling, 3 with a Hann window.
+
+// Multi-Tone Options
+const int multiToneDetection = 1; // Options: 1 (find up to multiToneCount tones in each block and log the frequency, amplitude and phase skew of each, to characterise the skew across frequency in one acquisition; disables tone tracking), 0 (only measure the strongest tone)
+const int multiToneCount = 8; // The largest number of tones reported per block. At most MAX_TONES.
+const double multiToneThresholdDb = 20.0; // Only local maxima at least this many dB above the noise floor, the median bin power, are reported as tones.
+const double multiToneMinLevelDb = -80.0; // Tones more than this many dB below the strongest bin are not reported, even if they stand above the noise floor.
+
+// Tone Tracking Options
+const int toneTracking = 1; // Options: 1 (once the detected frequency stays in the same bin, evaluate only that bin and its neighbours with the Goertzel algorithm instead of the full DFT), 0 (always calculate the full DFT)
+const int trackingLockBlocks = 5; // The number of consecutive blocks the detected frequency must stay in the same bin before tracking starts.
+const int trackingNeighbourBins = 2; // The number of bins evaluated on each side of the tracked bin.
+const double trackingMagnitudeDrop = 0.5; // Tracking stops, and the full DFT is calculated, if the tracked magnitude falls below this fraction of its value when tracking started.
+
+// File names
+const char *voltageDataFileName = "VoltageData.csv"; // Measurement data is stored in this CSV file
+const char *dftDataFileName = "DFTData.csv"; // DFT data is stored in this CSV file
+const char *slidingSkewDataFileName = "SlidingSkewData.csv"; // Phase skew updated by the sliding DFT is stored in this CSV file
+const char *gccPhatDataFileName = "GCCPHATData.csv"; // Delays measured by the GCC-PHAT estimator are stored in this CSV file
+const char *harmonicDataFileName = "HarmonicData.csv"; // Distortion measured by the harmonic analysis is stored in this CSV file
+const char *multiToneDataFileName = "MultiToneData.csv"; // Tones found by the multi-tone detection are stored in this CSV file
+const char *spectrogramFileName = "Spectrogram.stft"; // The binary spectrogram is stored in this file
+const char *spectrogramIndexFileName = "Spectrogram.idx"; // The index of the spectrogram is stored in this file
+const int voltageDataFileLogPrecision = 2; // Precision at which to store the voltage data
+const int dftDataFileLogPrecision = 3; // Precision at which to store the dft data